@@ -0,0 +1,55 @@
+#ifndef BENCH_BENCH_H
+#define BENCH_BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../interfaces/instrument.h"
+
+
+static inline unsigned long long bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// The run time of each benchmark in seconds, the first argument or 2
+static inline double bench_seconds(int argc, char *argv[]) {
+    double seconds = argc > 1 ? atof(argv[1]) : 0;
+
+    return seconds > 0 ? seconds : 2;
+}
+
+// Print one line per instrumented operation that ran: its count per read and its p50/p99/max latency
+static inline void bench_report_ops(const struct instr_snapshot *snapshot, unsigned long reads) {
+    for (unsigned int op = 0; op < INSTR_OP_COUNT; op++) {
+        const struct instr_histogram *h = &snapshot->ops[op];
+        if (!h->count)
+            continue;
+
+        printf("    %-14s %8.2f/read %6llu errors  p50 %10.3f µs  p99 %10.3f µs  max %10.3f µs\n",
+            instrument_name(op), reads ? (double)h->count / reads : 0.0, h->errors,
+            instrument_percentile(h, 0.50) / 1e3, instrument_percentile(h, 0.99) / 1e3, h->max_ns / 1e3);
+    }
+}
+
+static inline int bench_compare(const void *a, const void *b) {
+    unsigned long long x = *(const unsigned long long *)a, y = *(const unsigned long long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+// Print the count and p50/p99/max of n latencies measured by the benchmark itself, sorts them
+static inline void bench_report_latencies(const char *name, unsigned long long *ns, unsigned int n) {
+    if (!n)
+        return;
+
+    qsort(ns, n, sizeof(*ns), bench_compare);
+    printf("    %-14s %8u times          p50 %10.3f µs  p99 %10.3f µs  max %10.3f µs\n", name, n,
+        ns[n / 2] / 1e3, ns[(unsigned long long)n * 99 / 100] / 1e3, ns[n - 1] / 1e3);
+}
+
+
+#endif
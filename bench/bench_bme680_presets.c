@@ -0,0 +1,159 @@
+// Conversion time, I²C bytes, and output noise of each BME680 preset against the emulated sensor
+//
+//     bench_bme680_presets [seconds per preset]
+//
+// The emulated sensor returns fixed readings, so the noise is modelled: every measurement adds
+// Gaussian noise to the raw ADC values, divided by the square root of the oversampling, and the IIR
+// filter of the configuration register smooths temperature and pressure as the sensor's does. The
+// modelled samples are then compensated with the session's calibration like a read would be, which
+// gives the temperature in 0.01 °C steps, so less noise than that shows as none.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bench.h"
+#include "../interfaces/i2c_sim.h"
+#include "../sensors/bme680_sim.h"
+#include "../sensors/sensors.h"
+
+
+#define BUS     I2C_DEFAULT_BUS
+#define ADDR    BME680_ADDR_HIGH
+
+// the modelled samples per preset, the first ones only let the filter settle
+#define SAMPLES 100000
+#define SETTLE  1000
+
+// the raw readings and their noise at x1 in ADC counts, about 0.005 °C, 3.3 Pa, and 0.07 % like the
+// RMS noise of Bosch's datasheets; illustrative rather than measured
+#define TEMP_ADC    500000
+#define PRES_ADC    330000
+#define HUM_ADC     21000
+#define TEMP_NOISE  16.0
+#define PRES_NOISE  18.0
+#define HUM_NOISE   12.0
+
+static unsigned int temp_adc[SAMPLES], pres_adc[SAMPLES];
+static unsigned short hum_adc[SAMPLES];
+static float temp[SAMPLES], pres[SAMPLES], hum[SAMPLES];
+
+static uint64_t rng = 0x9E3779B97F4A7C15ULL;
+
+// a standard normal value (Box-Muller over xorshift64)
+static double gaussian(void) {
+    double u[2];
+    for (int i = 0; i < 2; i++) {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        u[i] = ((rng >> 11) + 0.5) / 9007199254740992.0;
+    }
+
+    return sqrt(-2 * log(u[0])) * cos(2 * M_PI * u[1]);
+}
+
+// the samples an oversampling setting (bits 2-0 of it) averages, 0 if it is skipped
+static unsigned int samples(unsigned int os) {
+    return os ? 1u << ((os > 5 ? 5 : os) - 1) : 0;
+}
+
+static double stddev(const float *values, unsigned int count) {
+    double mean = 0, sq = 0;
+    for (unsigned int i = 0; i < count; i++)
+        mean += values[i];
+    mean /= count;
+
+    // a second pass over the deviations, the one-pass difference of sums can round to below 0
+    for (unsigned int i = 0; i < count; i++)
+        sq += (values[i] - mean) * (values[i] - mean);
+
+    return sqrt(sq / count);
+}
+
+// Model the readings of the configuration the driver wrote to the sensor and print their noise
+static void model_noise(struct bme680 *dev) {
+    const unsigned char *regs = i2c_sim_registers(BUS, ADDR);
+
+    const unsigned int temp_os = samples(regs[0x74] >> 5), pres_os = samples(regs[0x74] >> 2 & 7);
+    const unsigned int hum_os = samples(regs[0x72] & 7);
+    const unsigned int coeff = (1u << (regs[0x75] >> 2 & 7)) - 1;
+
+    double temp_f = TEMP_ADC, pres_f = PRES_ADC;
+
+    for (unsigned int i = 0; i < SAMPLES; i++) {
+        double t = TEMP_ADC + (temp_os ? gaussian() * TEMP_NOISE / sqrt(temp_os) : 0);
+        double p = PRES_ADC + (pres_os ? gaussian() * PRES_NOISE / sqrt(pres_os) : 0);
+        double h = HUM_ADC  + (hum_os  ? gaussian() * HUM_NOISE  / sqrt(hum_os)  : 0);
+
+        // the IIR filter weighs the previous output coeff times the new sample
+        temp_f = (temp_f * coeff + t) / (coeff + 1);
+        pres_f = (pres_f * coeff + p) / (coeff + 1);
+
+        temp_adc[i] = lround(temp_f);
+        pres_adc[i] = lround(pres_f);
+        hum_adc[i]  = lround(h);
+    }
+
+    bme680_compensate(dev, SAMPLES, temp_adc, pres_adc, hum_adc, temp, pres, hum);
+
+    const unsigned int n = SAMPLES - SETTLE;
+    printf("    %-14s T %.4f °C  P %.3f Pa  H %.4f %% (standard deviation)\n", "noise",
+        stddev(temp + SETTLE, n), stddev(pres + SETTLE, n) * 100, stddev(hum + SETTLE, n));
+}
+
+static void run(struct bme680 *dev, const char *name, const struct bme680_config *config, double seconds) {
+    unsigned long bytes = i2c_sim_bytes();
+    if (bme680_configure(dev, config) == -1)
+        return;
+
+    const unsigned long config_bytes = i2c_sim_bytes() - bytes;
+
+    instrument_reset();
+    bytes = i2c_sim_bytes();
+
+    unsigned long reads = 0, failures = 0;
+    unsigned long long start = bench_now_ns(), end = start + seconds * 1e9, now;
+
+    do {
+        float t, p, h;
+        if (bme680_read(dev, &t, &p, &h) != 0)
+            failures++;
+
+        reads++;
+        now = bench_now_ns();
+    } while (now < end);
+
+    struct instr_snapshot snapshot;
+    instrument_snapshot(&snapshot);
+
+    const struct instr_histogram *read = &snapshot.ops[INSTR_BME680_READ];
+
+    printf("%-16s %10.1f reads/s  %lu reads  %lu failed\n", name, reads / ((now - start) / 1e9), reads, failures);
+    printf("    %-14s p50 %10.3f ms  p99 %10.3f ms\n", "conversion",
+        instrument_percentile(read, 0.50) / 1e6, instrument_percentile(read, 0.99) / 1e6);
+    printf("    %-14s %lu to configure, %.1f per read\n", "bus bytes", config_bytes,
+        (double)(i2c_sim_bytes() - bytes) / reads);
+
+    model_noise(dev);
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = bench_seconds(argc, argv);
+
+    i2c_set_transport(&i2c_sim_transport);
+    bme680_sim_add(BUS, ADDR, NULL);
+    bme680_sim_set_adc(BUS, ADDR, TEMP_ADC, PRES_ADC, HUM_ADC);
+
+    struct bme680 *dev = bme680_open(BUS, ADDR);
+    if (!dev)
+        return 1;
+
+    run(dev, "low_latency", &bme680_low_latency, seconds);
+    run(dev, "balanced", &bme680_balanced, seconds);
+    run(dev, "low_noise", &bme680_low_noise, seconds);
+
+    bme680_close(dev);
+
+    return 0;
+}
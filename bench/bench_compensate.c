@@ -0,0 +1,107 @@
+// Samples per second of the BME680 batch compensation against one decode per sample
+//
+//     bench_compensate [seconds per path]
+//
+// Both paths run over the same million samples around a room-temperature reading, as many passes as fit
+// in the time. bench_compensate_scalar is this benchmark against the library compiled with
+// PERIPHERY_SCALAR, so comparing the two gives the gain of the SSE4.1 kernel.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+#include "../interfaces/i2c_sim.h"
+#include "../sensors/bme680_sim.h"
+#include "../sensors/sensors.h"
+
+
+#define BUS     I2C_DEFAULT_BUS
+#define ADDR    BME680_ADDR_HIGH
+
+#define SAMPLES (1u << 20)
+
+static unsigned int temp_adc[SAMPLES], pres_adc[SAMPLES];
+static unsigned short hum_adc[SAMPLES];
+static float temp[SAMPLES], pres[SAMPLES], hum[SAMPLES];
+
+// the burst reads from 0x1D the decode path gets instead
+static unsigned char raw[SAMPLES][10];
+
+static uint64_t rng = 0x9E3779B97F4A7C15ULL;
+
+// a value in [0, range) (xorshift64)
+static unsigned int uniform(unsigned int range) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+
+    return rng % range;
+}
+
+static void report(const char *name, unsigned long long samples, unsigned long long ns) {
+    printf("%-18s %8.1f Msamples/s  %8.3f ns/sample  %llu samples\n", name,
+        samples / (ns / 1e3), (double)ns / samples, samples);
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = bench_seconds(argc, argv);
+
+    // only for the calibration of the session
+    i2c_set_transport(&i2c_sim_transport);
+    bme680_sim_add(BUS, ADDR, NULL);
+
+    struct bme680 *dev = bme680_open(BUS, ADDR);
+    if (!dev)
+        return 1;
+
+    for (unsigned int i = 0; i < SAMPLES; i++) {
+        temp_adc[i] = 500000 + uniform(20000);
+        pres_adc[i] = 330000 + uniform(20000);
+        hum_adc[i]  = 21000 + uniform(4000);
+
+        const unsigned char burst[10] = {
+            0x80, 0,
+            pres_adc[i] >> 12, pres_adc[i] >> 4, pres_adc[i] << 4,
+            temp_adc[i] >> 12, temp_adc[i] >> 4, temp_adc[i] << 4,
+            hum_adc[i] >> 8, hum_adc[i],
+        };
+        memcpy(raw[i], burst, sizeof(burst));
+    }
+
+#ifdef PERIPHERY_SCALAR
+    const char *batch = "batch (scalar)";
+#else
+    const char *batch = "batch (sse4.1)";
+#endif
+
+    unsigned long long samples = 0, start = bench_now_ns(), end = start + seconds * 1e9, now;
+    do {
+        bme680_compensate(dev, SAMPLES, temp_adc, pres_adc, hum_adc, temp, pres, hum);
+
+        samples += SAMPLES;
+        now = bench_now_ns();
+    } while (now < end);
+
+    report(batch, samples, now - start);
+
+    samples = 0;
+    start = bench_now_ns();
+    end = start + seconds * 1e9;
+    do {
+        for (unsigned int i = 0; i < SAMPLES; i++) {
+            float t, p, h;
+            bme680_decode_raw(dev, raw[i], sizeof(raw[i]));
+            bme680_result(dev, &t, &p, &h);
+        }
+
+        samples += SAMPLES;
+        now = bench_now_ns();
+    } while (now < end);
+
+    report("decode per sample", samples, now - start);
+
+    bme680_close(dev);
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+// Reads per second, bus operations per read, and p50/p99 latencies of each driver and the interface
+// primitives under it, against the simulated hardware
+//
+//     bench_drivers [seconds per driver]
+
+#include <stdio.h>
+
+#include "bench.h"
+#include "../interfaces/gpio_sim.h"
+#include "../interfaces/i2c_sim.h"
+#include "../sensors/bme680_sim.h"
+#include "../sensors/mh_z19c_sim.h"
+#include "../sensors/sensors.h"
+#include "../tests/dht22_waveform.h"
+
+
+#define DHT_PIN 17
+
+// Call read until seconds passed and print the results, the counters start over for each driver
+static void run(const char *name, int (*read)(void *arg), void *arg, double seconds) {
+    instrument_reset();
+
+    unsigned long reads = 0, failures = 0;
+    unsigned long long start = bench_now_ns(), end = start + seconds * 1e9, now;
+
+    do {
+        if (read(arg) != 0)
+            failures++;
+
+        reads++;
+        now = bench_now_ns();
+    } while (now < end);
+
+    struct instr_snapshot snapshot;
+    instrument_snapshot(&snapshot);
+
+    printf("%-16s %10.1f reads/s  %lu reads  %lu failed\n", name, reads / ((now - start) / 1e9), reads, failures);
+    bench_report_ops(&snapshot, reads);
+}
+
+static int read_bme680(void *arg) {
+    (void)arg;
+    float temp, pres, hum;
+
+    return read_bme680_data(&temp, &pres, &hum);
+}
+
+static int read_bme680_session(void *arg) {
+    float temp, pres, hum;
+
+    return bme680_read(arg, &temp, &pres, &hum);
+}
+
+static int read_dht22(void *arg) {
+    (void)arg;
+    float temp, hum;
+
+    return read_dht22_data(&temp, &hum);
+}
+
+static int read_z19c(void *arg) {
+    (void)arg;
+    unsigned short co2;
+
+    return read_z19c_data(&co2);
+}
+
+static int read_z19c_session(void *arg) {
+    unsigned short co2;
+
+    return z19c_read(arg, &co2, -1);
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = bench_seconds(argc, argv);
+
+    // BME680 on the simulated I²C bus, the read time is the conversion time of the balanced preset
+    i2c_set_transport(&i2c_sim_transport);
+    bme680_sim_add(I2C_DEFAULT_BUS, BME680_ADDR_HIGH, NULL);
+
+    run("read_bme680_data", read_bme680, NULL, seconds);
+
+    struct bme680 *bme680 = bme680_open(I2C_DEFAULT_BUS, BME680_ADDR_HIGH);
+    if (bme680) {
+        run("bme680_read", read_bme680_session, bme680, seconds);
+        bme680_close(bme680);
+    }
+
+    // DHT22 on the simulated GPIO block, replaying one transmission on every release of the line
+    static struct GPIO_simStep steps[DHT22_WAVEFORM_STEPS];
+    unsigned char frame[5];
+    dht22_frame(frame, 215, 500);
+    dht22_waveform(steps, frame, 27, 70);
+
+    GPIO_initBackend(&GPIO_simBackend);
+    GPIO_simScript(DHT_PIN, steps, DHT22_WAVEFORM_STEPS);
+
+    run("read_dht22_data", read_dht22, NULL, seconds);
+
+    // MH-Z19C on the pseudo-terminal emulator, answering right away
+    struct z19c_sim *sim = z19c_sim_start(&(struct z19c_sim_config){ .co2 = 800 });
+    if (sim) {
+        z19c_set_path(z19c_sim_path(sim));
+        run("read_z19c_data", read_z19c, NULL, seconds);
+
+        struct z19c *z19c = z19c_open(z19c_sim_path(sim));
+        if (z19c) {
+            run("z19c_read", read_z19c_session, z19c, seconds);
+            z19c_close(z19c);
+        }
+
+        z19c_set_path(NULL);
+        z19c_sim_stop(sim);
+    }
+
+    return 0;
+}
@@ -0,0 +1,160 @@
+// Latency of getting a sensor value from the shared memory sensord publishes to, against calling the
+// drivers directly on the simulated hardware
+//
+//     bench_shm [seconds per case]
+//
+// The shared memory is mapped a second time read-only as a client process maps it, while a thread
+// publishes to it like sensord; each call is timed on its own, so its latencies include one clock read.
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "bench.h"
+#include "../interfaces/i2c_sim.h"
+#include "../sensors/bme680_sim.h"
+#include "../sensors/mh_z19c_sim.h"
+#include "../sensors/sample_shm.h"
+#include "../sensors/sensors.h"
+
+
+#define SHM_NAME "/raspberry-periphery-bench"
+
+// the most calls whose latency is kept per case
+#define MAX_CALLS (1u << 20)
+
+static struct bme680 *bme680;
+static struct z19c *z19c;
+
+static atomic_int publishing;
+
+static int read_bme680(void) {
+    float temp, pres, hum;
+
+    return bme680_read(bme680, &temp, &pres, &hum);
+}
+
+static int read_z19c(void) {
+    unsigned short co2;
+
+    return z19c_read(z19c, &co2, -1);
+}
+
+// Call a driver until seconds passed and print its reads/s and latencies
+static void run_direct(const char *name, int (*read)(void), double seconds) {
+    instrument_reset();
+
+    unsigned long reads = 0, failures = 0;
+    unsigned long long start = bench_now_ns(), end = start + seconds * 1e9, now;
+
+    do {
+        if (read() != 0)
+            failures++;
+
+        reads++;
+        now = bench_now_ns();
+    } while (now < end);
+
+    struct instr_snapshot snapshot;
+    instrument_snapshot(&snapshot);
+
+    printf("%-24s %12.1f reads/s  %lu reads  %lu failed\n", name, reads / ((now - start) / 1e9), reads, failures);
+    bench_report_ops(&snapshot, reads);
+}
+
+// Get the newest sample of a sensor until seconds passed and print the calls/s and latencies
+static void run_shm(const char *name, const struct sample_bus *bus, unsigned int sensor_id, double seconds) {
+    static unsigned long long latencies[MAX_CALLS];
+    unsigned int n = 0;
+
+    unsigned long calls = 0, misses = 0;
+    unsigned long long start = bench_now_ns(), end = start + seconds * 1e9, now = start;
+
+    do {
+        struct sample sample;
+        unsigned long long before = now;
+
+        if (!sample_bus_latest(bus, sensor_id, &sample))
+            misses++;
+
+        now = bench_now_ns();
+        if (n < MAX_CALLS)
+            latencies[n++] = now - before;
+
+        calls++;
+    } while (now < end);
+
+    printf("%-24s %12.1f reads/s  %lu reads  %lu without a sample\n", name, calls / ((now - start) / 1e9), calls, misses);
+    bench_report_latencies("sample_latest", latencies, n);
+}
+
+// Read the sensors like sensord does, every read publishes a sample
+static void *publish(void *arg) {
+    (void)arg;
+
+    while (atomic_load(&publishing)) {
+        read_bme680();
+        read_z19c();
+    }
+
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = bench_seconds(argc, argv);
+
+    i2c_set_transport(&i2c_sim_transport);
+    bme680_sim_add(I2C_DEFAULT_BUS, BME680_ADDR_HIGH, NULL);
+
+    struct z19c_sim *sim = z19c_sim_start(&(struct z19c_sim_config){ .co2 = 800 });
+    if (!sim)
+        return 1;
+
+    bme680 = bme680_open(I2C_DEFAULT_BUS, BME680_ADDR_HIGH);
+    z19c = z19c_open(z19c_sim_path(sim));
+
+    struct sample_shm shm, client;
+    if (!bme680 || !z19c || sample_shm_create(&shm, SHM_NAME, SAMPLE_SHM_HISTORY) == -1) {
+        fputs("Error: could not set up the simulated sensors and the shared memory\n", stderr);
+        return 1;
+    }
+
+    // the drivers on their own
+    run_direct("bme680_read", read_bme680, seconds);
+    run_direct("z19c_read", read_z19c, seconds);
+
+    // the drivers publishing from their own thread, the values read back from the client mapping
+    bme680_set_bus(bme680, shm.bus, SAMPLE_SHM_BME680);
+    z19c_set_bus(z19c, shm.bus, SAMPLE_SHM_Z19C);
+
+    if (sample_shm_open(&client, SHM_NAME) == -1)
+        return 1;
+
+    atomic_store(&publishing, 1);
+
+    pthread_t publisher;
+    pthread_create(&publisher, NULL, publish, NULL);
+
+    // time only calls that find a sample
+    struct sample sample;
+    while (!sample_bus_latest(client.bus, SAMPLE_SHM_BME680, &sample) ||
+           !sample_bus_latest(client.bus, SAMPLE_SHM_Z19C, &sample))
+        sched_yield();
+
+    run_shm("shm bme680", client.bus, SAMPLE_SHM_BME680, seconds);
+    run_shm("shm z19c", client.bus, SAMPLE_SHM_Z19C, seconds);
+
+    atomic_store(&publishing, 0);
+    pthread_join(publisher, NULL);
+
+    sample_shm_close(&client);
+    sample_shm_close(&shm);
+    sample_shm_unlink(SHM_NAME);
+
+    bme680_close(bme680);
+    z19c_close(z19c);
+    z19c_sim_stop(sim);
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+// Reads per second of the MH-Z19C driver against slow, fragmented, and noisy emulated sensors, and how
+// long it takes to get a reading again after a corrupted response
+//
+//     bench_z19c [seconds per case]
+
+#include <stdio.h>
+
+#include "bench.h"
+#include "../sensors/mh_z19c_sim.h"
+#include "../sensors/sensors.h"
+
+
+// the most failures whose recovery is timed per case
+#define MAX_RECOVERIES 4096
+
+// Read until seconds passed and print the results, a recovery runs from the start of a failed read
+// to the end of the next successful one
+static void run(struct z19c_sim *sim, struct z19c *dev, const char *name,
+                const struct z19c_sim_config *config, int timeout, double seconds) {
+    static unsigned long long recoveries[MAX_RECOVERIES];
+    unsigned int n = 0;
+
+    z19c_sim_configure(sim, config);
+    instrument_reset();
+
+    unsigned long reads = 0, failures = 0;
+    unsigned long long start = bench_now_ns(), end = start + seconds * 1e9, now, failed = 0;
+
+    do {
+        unsigned long long begin = bench_now_ns();
+        unsigned short co2;
+        int rc = z19c_read(dev, &co2, timeout);
+
+        now = bench_now_ns();
+        reads++;
+
+        if (rc != 0) {
+            failures++;
+            if (!failed)
+                failed = begin;
+        }
+        else if (failed) {
+            if (n < MAX_RECOVERIES)
+                recoveries[n++] = now - failed;
+            failed = 0;
+        }
+    } while (now < end);
+
+    struct instr_snapshot snapshot;
+    instrument_snapshot(&snapshot);
+
+    printf("%-20s %10.1f reads/s  %lu reads  %lu failed\n", name, reads / ((now - start) / 1e9), reads, failures);
+    bench_report_ops(&snapshot, reads);
+
+    bench_report_latencies("recovery", recoveries, n);
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = bench_seconds(argc, argv);
+
+    struct z19c_sim *sim = z19c_sim_start(&(struct z19c_sim_config){ .co2 = 800 });
+    if (!sim)
+        return 1;
+
+    struct z19c *dev = z19c_open(z19c_sim_path(sim));
+    if (!dev) {
+        z19c_sim_stop(sim);
+        return 1;
+    }
+
+    run(sim, dev, "immediate", &(struct z19c_sim_config){ .co2 = 800 }, -1, seconds);
+    run(sim, dev, "delay 1 ms", &(struct z19c_sim_config){ .co2 = 800, .delay_ms = 1 }, -1, seconds);
+    run(sim, dev, "fragments of 2",
+        &(struct z19c_sim_config){ .co2 = 800, .fragment = 2, .fragment_delay_ms = 1 }, -1, seconds);
+    run(sim, dev, "garbage 32", &(struct z19c_sim_config){ .co2 = 800, .garbage = 32 }, -1, seconds);
+
+    // a corrupted checksum is only given up on at the timeout, so that bounds the recovery
+    run(sim, dev, "corrupt 1/4, 20 ms", &(struct z19c_sim_config){ .co2 = 800, .corrupt_every = 4 }, 20, seconds);
+    run(sim, dev, "corrupt 1/4, 100 ms", &(struct z19c_sim_config){ .co2 = 800, .corrupt_every = 4 }, 100, seconds);
+
+    z19c_close(dev);
+    z19c_sim_stop(sim);
+
+    return 0;
+}
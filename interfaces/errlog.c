@@ -0,0 +1,352 @@
+#include "errlog.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+
+
+// The queued events, a power of two
+#define RING_SIZE           256
+#define DEFAULT_RATE_LIMIT  10
+
+// A queue slot is a seqlock: seq is 2 * position + 1 while the event at position is written
+// and 2 * position + 2 once it is complete
+struct slot {
+    atomic_ullong seq;
+    struct errlog_event event;
+};
+
+static struct slot ring[RING_SIZE];
+static atomic_ullong head;
+
+// the position of the next event to drain, guarded by drain_lock
+static unsigned long long tail;
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// the events of each code passed in the current second
+static struct {
+    atomic_ullong second;
+    atomic_uint count;
+} rates[ERR_CODE_COUNT];
+
+static atomic_uint rate_limit = DEFAULT_RATE_LIMIT;
+static atomic_ulong dropped;
+
+static void (*_Atomic callback)(const struct errlog_event *event, void *arg);
+static void *_Atomic callback_arg;
+
+static _Thread_local struct errlog_event last;
+
+static pthread_t logger;
+static FILE *logger_stream;
+static unsigned int logger_period_ms;
+// the drops before the logger started are not its to report
+static unsigned long logger_reported;
+static atomic_int logger_running;
+
+// The messages of the codes, with one conversion for the arg or (for the ones marked) the detail
+static const struct {
+    const char *format;
+    int detail;
+} messages[ERR_CODE_COUNT] = {
+    [ERR_NONE]               = { "No error", 0 },
+
+    [ERR_I2C_HANDLE]         = { "Error: Invalid I²C handle %d", 0 },
+    [ERR_I2C_BUS]            = { "Error opening I²C bus %d: No such bus", 0 },
+    [ERR_I2C_FULL]           = { "Error opening I²C device 0x%X: Too many open devices", 0 },
+    [ERR_I2C_OPEN]           = { "Error opening I²C %s", 1 },
+    [ERR_I2C_CLOSE]          = { "Error closing I²C", 0 },
+    [ERR_I2C_SELECT]         = { "Error selecting I²C device 0x%X", 0 },
+    [ERR_I2C_SEGMENTS]       = { "Error reading from I²C: Too many segments (%d)", 0 },
+    [ERR_I2C_READ]           = { "Error reading from I²C address 0x%x", 0 },
+    [ERR_I2C_WRITE]          = { "Error writing to I²C address 0x%x", 0 },
+    [ERR_I2C_SIM_FULL]       = { "Error adding simulated I²C device 0x%X: Bus is full", 0 },
+    [ERR_I2C_SIM_DEVICE]     = { "Error selecting simulated I²C device 0x%X: No such device", 0 },
+
+    [ERR_SERIAL_OPEN]        = { "Error opening serial %s", 1 },
+    [ERR_SERIAL_GET_PARAMS]  = { "Error getting serial parameters for %s", 1 },
+    [ERR_SERIAL_SET_SPEED]   = { "Error setting serial speed for %s", 1 },
+    [ERR_SERIAL_SET_PARAMS]  = { "Error setting serial parameters for %s", 1 },
+    [ERR_SERIAL_CLOSE]       = { "Error closing serial", 0 },
+    [ERR_SERIAL_READ]        = { "Error reading from serial", 0 },
+    [ERR_SERIAL_WRITE]       = { "Error writing to serial", 0 },
+    [ERR_SERIAL_WAIT]        = { "Error waiting for serial", 0 },
+    [ERR_SERIAL_FLUSH]       = { "Error flushing serial", 0 },
+
+    [ERR_GPIO_OPEN]          = { "Error opening '%s'", 1 },
+    [ERR_GPIO_MAP]           = { "Error mapping the GPIO registers", 0 },
+    [ERR_GPIO_MODE]          = { "Error: Wrong mode specified. Either use GPIO_IN or GPIO_OUT", 0 },
+    [ERR_GPIO_PIN]           = { "Error: GPIO pin %d is not supported", 0 },
+    [ERR_GPIO_EDGE]          = { "Error: Wrong edge specified. Either use GPIO_FALLING, GPIO_RISING or GPIO_BOTH", 0 },
+    [ERR_GPIO_REQUEST]       = { "Error requesting edge events for GPIO %d", 0 },
+    [ERR_GPIO_POLL]          = { "Error polling for GPIO edges", 0 },
+    [ERR_GPIO_READ]          = { "Error reading GPIO edges", 0 },
+    [ERR_GPIO_UNWATCH]       = { "Error closing GPIO edge watcher", 0 },
+    [ERR_GPIO_SAMPLER_START] = { "Error starting GPIO sampler", 0 },
+    [ERR_GPIO_SAMPLER_JOIN]  = { "Error joining GPIO sampler", 0 },
+
+    [ERR_DHT22_MODE]         = { "Error: Wrong DHT22 mode %d specified", 0 },
+    [ERR_DHT22_AFFINITY]     = { "Error pinning to CPU %d", 0 },
+    [ERR_DHT22_SCHED]        = { "Error setting SCHED_FIFO", 0 },
+    [ERR_DHT22_LOCK]         = { "Error locking memory", 0 },
+    [ERR_DHT22_BUSY]         = { "Error: DHT22 read already in progress", 0 },
+    [ERR_DHT22_RAW_LENGTH]   = { "Error: Invalid DHT22 raw data length %d", 0 },
+
+    [ERR_BME680_CONFIG]      = { "Error: Invalid BME680 configuration", 0 },
+    [ERR_BME680_STEPS]       = { "Error: Too many BME680 heater steps (%d)", 0 },
+    [ERR_BME680_CALIB]       = { "Error: Invalid BME680 calibration length %d", 0 },
+    [ERR_BME680_NOT_READY]   = { "Error: BME680 measurement not ready in time", 0 },
+    [ERR_BME680_RAW_LENGTH]  = { "Error: Invalid BME680 raw data length %d", 0 },
+    [ERR_Z19C_CHECKSUM]      = { "Error: Wrong MH-Z19C checksum, got 0x%X", 0 },
+    [ERR_Z19C_TIMEOUT]       = { "Timeout waiting for MH-Z19C response, got %d of 9 bytes", 0 },
+    [ERR_Z19C_FRAME]         = { "Error: Invalid MH-Z19C frame", 0 },
+    [ERR_Z19C_SIM_PTY]       = { "Error opening pseudo-terminal", 0 },
+    [ERR_Z19C_SIM_START]     = { "Error starting MH-Z19C emulator", 0 },
+
+    [ERR_RAW_LOG_CREATE]     = { "Error creating raw log %s", 1 },
+    [ERR_RAW_LOG_OPEN]       = { "Error opening raw log %s", 1 },
+    [ERR_RAW_LOG_MAP]        = { "Error mapping raw log %s", 1 },
+    [ERR_RAW_LOG_FORMAT]     = { "Error opening raw log %s: Not a raw log", 1 },
+    [ERR_RAW_LOG_LENGTH]     = { "Error writing raw log: Record too long (%d)", 0 },
+    [ERR_RAW_LOG_WRITE]      = { "Error writing raw log", 0 },
+    [ERR_RAW_LOG_REPLAY]     = { "Error replaying raw log: More than %d BME680s", 0 },
+    [ERR_SHM_CREATE]         = { "Error creating shared memory %s", 1 },
+    [ERR_SHM_SIZE]           = { "Error sizing shared memory %s", 1 },
+    [ERR_SHM_MAP]            = { "Error mapping shared memory %s", 1 },
+    [ERR_SHM_OPEN]           = { "Error opening shared memory %s", 1 },
+    [ERR_SHM_EMPTY]          = { "Error opening shared memory %s: Not initialized", 1 },
+    [ERR_SHM_FORMAT]         = { "Error opening shared memory %s: Not a sample bus", 1 },
+    [ERR_SHM_UNLINK]         = { "Error removing shared memory %s", 1 },
+    [ERR_SCHED_CREATE]       = { "Error creating epoll", 0 },
+    [ERR_SCHED_ADD]          = { "Error adding sensor with period %d ms: Too many sensors or no period", 0 },
+    [ERR_SCHED_TIMER]        = { "Error creating timer", 0 },
+    [ERR_SCHED_WATCH]        = { "Error adding fd %d to epoll", 0 },
+    [ERR_SCHED_WAIT]         = { "Error waiting for epoll", 0 },
+};
+
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Count an event of code in the current second, returns 0 once there were too many
+static int within_rate(enum errlog_code code, unsigned long long timestamp_ns) {
+    unsigned int limit = atomic_load_explicit(&rate_limit, memory_order_relaxed);
+    if (!limit)
+        return 1;
+
+    unsigned long long second = timestamp_ns / 1000000000;
+    unsigned long long current = atomic_load_explicit(&rates[code].second, memory_order_relaxed);
+
+    // the first event of a new second starts the count over, racing threads may both do so
+    if (current != second &&
+        atomic_compare_exchange_strong(&rates[code].second, &current, second))
+        atomic_store_explicit(&rates[code].count, 0, memory_order_relaxed);
+
+    return atomic_fetch_add_explicit(&rates[code].count, 1, memory_order_relaxed) < limit;
+}
+
+void errlog_record_detail(enum errlog_code code, int err, int arg, const char *detail) {
+    struct errlog_event *event = &last;
+
+    event->code = code;
+    event->err  = err;
+    event->arg  = arg;
+    event->timestamp_ns = now_ns();
+
+    event->detail[0] = '\0';
+    if (detail) {
+        strncpy(event->detail, detail, sizeof(event->detail) - 1);
+        event->detail[sizeof(event->detail) - 1] = '\0';
+    }
+
+    if ((unsigned int)code >= ERR_CODE_COUNT || !within_rate(code, event->timestamp_ns)) {
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    void (*cb)(const struct errlog_event *, void *) = atomic_load(&callback);
+    if (cb)
+        cb(event, atomic_load(&callback_arg));
+
+    // queue it, overwriting the oldest event if errlog_drain fell behind
+    unsigned long long pos = atomic_fetch_add_explicit(&head, 1, memory_order_relaxed);
+    struct slot *slot = &ring[pos % RING_SIZE];
+    const unsigned long long writing = 2 * pos + 1;
+
+    // take the slot over from an event of an earlier lap like sample_bus_publish does; if a writer a
+    // lap ahead got to it while this one was preempted, the newer event stays and this one is dropped,
+    // errlog_drain counts it when it skips the position
+    unsigned long long seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    for (;;) {
+        if (seq >= writing)
+            return;
+
+        if (seq & 1)
+            seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+        else if (atomic_compare_exchange_weak_explicit(&slot->seq, &seq, writing,
+                                                       memory_order_acquire, memory_order_relaxed))
+            break;
+    }
+
+    atomic_thread_fence(memory_order_release);
+
+    slot->event = *event;
+
+    // the odd seq keeps every other writer off the slot, so it can not have changed
+    atomic_store_explicit(&slot->seq, writing + 1, memory_order_release);
+}
+
+void errlog_record(enum errlog_code code, int err, int arg) {
+    errlog_record_detail(code, err, arg, NULL);
+}
+
+enum errlog_code errlog_last(struct errlog_event *event) {
+    if (event)
+        *event = last;
+
+    return last.code;
+}
+
+void errlog_set_callback(void (*cb)(const struct errlog_event *event, void *arg), void *arg) {
+    atomic_store(&callback_arg, arg);
+    atomic_store(&callback, cb);
+}
+
+void errlog_set_rate_limit(unsigned int per_second) {
+    atomic_store(&rate_limit, per_second);
+}
+
+unsigned long errlog_dropped(void) {
+    return atomic_load(&dropped);
+}
+
+unsigned int errlog_drain(struct errlog_event *events, unsigned int max) {
+    unsigned int n = 0;
+
+    pthread_mutex_lock(&drain_lock);
+
+    while (n < max) {
+        struct slot *slot = &ring[tail % RING_SIZE];
+        const unsigned long long want = 2 * tail + 2;
+
+        unsigned long long seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+        // not recorded yet or still being written
+        if (seq < want)
+            break;
+
+        if (seq == want) {
+            events[n] = slot->event;
+
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == want) {
+                n++;
+                tail++;
+
+                continue;
+            }
+        }
+
+        // overwritten, continue at the oldest event still queued
+        unsigned long long oldest = atomic_load_explicit(&head, memory_order_acquire) - RING_SIZE;
+
+        atomic_fetch_add_explicit(&dropped, oldest - tail, memory_order_relaxed);
+        tail = oldest;
+    }
+
+    pthread_mutex_unlock(&drain_lock);
+
+    return n;
+}
+
+int errlog_format(const struct errlog_event *event, char *buffer, unsigned int size) {
+    if ((unsigned int)event->code >= ERR_CODE_COUNT)
+        return snprintf(buffer, size, "Unknown error %d", event->code);
+
+    int n = messages[event->code].detail ?
+        snprintf(buffer, size, messages[event->code].format, event->detail) :
+        snprintf(buffer, size, messages[event->code].format, event->arg);
+
+    if (event->err && n >= 0 && (unsigned int)n < size)
+        n += snprintf(&buffer[n], size - n, ": %s (-%d)", strerror(event->err), event->err);
+
+    return n;
+}
+
+static void flush_events(void) {
+    struct errlog_event events[16];
+    unsigned int n;
+
+    while ((n = errlog_drain(events, 16)) > 0) {
+        for (unsigned int i = 0; i < n; i++) {
+            char message[160];
+            errlog_format(&events[i], message, sizeof(message));
+
+            fprintf(logger_stream, "%s.\n", message);
+        }
+    }
+}
+
+static void *logger_thread(void *arg) {
+    (void)arg;
+    unsigned long reported = logger_reported;
+
+    int running;
+    do {
+        running = atomic_load(&logger_running);
+        if (running) {
+            struct timespec ts = { logger_period_ms / 1000, (logger_period_ms % 1000) * 1000000L };
+            nanosleep(&ts, NULL);
+        }
+
+        flush_events();
+
+        unsigned long total = errlog_dropped();
+        if (total != reported) {
+            fprintf(logger_stream, "%lu error messages suppressed.\n", total - reported);
+            reported = total;
+        }
+    } while (running);
+
+    return NULL;
+}
+
+int errlog_start_logger(FILE *stream, unsigned int period_ms) {
+    if (atomic_exchange(&logger_running, 1))
+        return -1;
+
+    logger_stream    = stream;
+    logger_period_ms = period_ms ? period_ms : 1;
+    logger_reported  = errlog_dropped();
+
+    // the thread inherits the blocked signals, leave them to the application's threads
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+
+    int rc = pthread_create(&logger, NULL, logger_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (rc != 0) {
+        // there is no logger to report it
+        fprintf(stream, "Error starting the error logger: %s (-%d).\n", strerror(rc), rc);
+        atomic_store(&logger_running, 0);
+
+        return -1;
+    }
+
+    return 0;
+}
+
+void errlog_stop_logger(void) {
+    if (!atomic_exchange(&logger_running, 0))
+        return;
+
+    pthread_join(logger, NULL);
+}
@@ -0,0 +1,129 @@
+#ifndef INTERFACES_ERRLOG_H
+#define INTERFACES_ERRLOG_H
+
+#include <stdio.h>
+
+
+// What failed, the comments name what the event's arg holds
+enum errlog_code {
+    ERR_NONE,
+
+    ERR_I2C_HANDLE,         // the handle
+    ERR_I2C_BUS,            // the bus number
+    ERR_I2C_FULL,           // the device address
+    ERR_I2C_OPEN,           // the bus number, detail is the path
+    ERR_I2C_CLOSE,
+    ERR_I2C_SELECT,         // the device address
+    ERR_I2C_SEGMENTS,       // the number of segments
+    ERR_I2C_READ,           // the register address
+    ERR_I2C_WRITE,          // the register address
+    ERR_I2C_SIM_FULL,       // the device address
+    ERR_I2C_SIM_DEVICE,     // the device address
+
+    ERR_SERIAL_OPEN,        // detail is the path, as for the three below
+    ERR_SERIAL_GET_PARAMS,
+    ERR_SERIAL_SET_SPEED,
+    ERR_SERIAL_SET_PARAMS,
+    ERR_SERIAL_CLOSE,
+    ERR_SERIAL_READ,
+    ERR_SERIAL_WRITE,
+    ERR_SERIAL_WAIT,
+    ERR_SERIAL_FLUSH,
+
+    ERR_GPIO_OPEN,          // detail is the path
+    ERR_GPIO_MAP,
+    ERR_GPIO_MODE,
+    ERR_GPIO_PIN,           // the pin
+    ERR_GPIO_EDGE,
+    ERR_GPIO_REQUEST,       // the pin
+    ERR_GPIO_POLL,
+    ERR_GPIO_READ,
+    ERR_GPIO_UNWATCH,
+    ERR_GPIO_SAMPLER_START,
+    ERR_GPIO_SAMPLER_JOIN,
+
+    ERR_DHT22_MODE,         // the mode
+    ERR_DHT22_AFFINITY,     // the cpu
+    ERR_DHT22_SCHED,
+    ERR_DHT22_LOCK,
+    ERR_DHT22_BUSY,
+    ERR_DHT22_RAW_LENGTH,   // the length
+    ERR_BME680_CONFIG,
+    ERR_BME680_STEPS,       // the number of steps
+    ERR_BME680_CALIB,       // the length
+    ERR_BME680_NOT_READY,
+    ERR_BME680_RAW_LENGTH,  // the length
+    ERR_Z19C_CHECKSUM,      // the received checksum
+    ERR_Z19C_TIMEOUT,       // the bytes received
+    ERR_Z19C_FRAME,
+    ERR_Z19C_SIM_PTY,
+    ERR_Z19C_SIM_START,
+
+    ERR_RAW_LOG_CREATE,     // detail is the path, as for the three below
+    ERR_RAW_LOG_OPEN,
+    ERR_RAW_LOG_MAP,
+    ERR_RAW_LOG_FORMAT,
+    ERR_RAW_LOG_LENGTH,     // the record length
+    ERR_RAW_LOG_WRITE,
+    ERR_RAW_LOG_REPLAY,     // the most BME680s it replays
+    ERR_SHM_CREATE,         // detail is the name, as for the six below
+    ERR_SHM_SIZE,
+    ERR_SHM_MAP,
+    ERR_SHM_OPEN,
+    ERR_SHM_EMPTY,
+    ERR_SHM_FORMAT,
+    ERR_SHM_UNLINK,
+    ERR_SCHED_CREATE,
+    ERR_SCHED_ADD,          // the period
+    ERR_SCHED_TIMER,
+    ERR_SCHED_WATCH,        // the file descriptor
+    ERR_SCHED_WAIT,
+
+    ERR_CODE_COUNT
+};
+
+#define ERRLOG_DETAIL_SIZE  32
+
+struct errlog_event {
+    enum errlog_code code;
+    // the errno of the failed call, 0 if there was none
+    int err;
+    int arg;
+
+    // CLOCK_MONOTONIC in ns
+    unsigned long long timestamp_ns;
+
+    // a path or name, only for the errors of opening something
+    char detail[ERRLOG_DETAIL_SIZE];
+};
+
+// Record a failure: keeps it as the calling thread's last error, then, unless its code exceeded the
+// rate limit, calls the callback and queues it for errlog_drain; does not format or print anything
+//
+// The functions of the drivers and interfaces return -1 (or NULL) and record the reason here,
+// errlog_last is how the caller gets the code and errno of the failure
+void errlog_record(enum errlog_code code, int err, int arg);
+void errlog_record_detail(enum errlog_code code, int err, int arg, const char *detail);
+
+// Get the last error of the calling thread (event may be NULL), returns its code or ERR_NONE
+enum errlog_code errlog_last(struct errlog_event *event);
+
+// Called on the failing thread for every event within the rate limit, NULL removes it
+void errlog_set_callback(void (*callback)(const struct errlog_event *event, void *arg), void *arg);
+// Pass at most per_second events of each code, 0 passes all; the default is 10
+void errlog_set_rate_limit(unsigned int per_second);
+// The events dropped by the rate limit or overwritten before errlog_drain got to them
+unsigned long errlog_dropped(void);
+
+// Take up to max queued events, oldest first, returns their number
+unsigned int errlog_drain(struct errlog_event *events, unsigned int max);
+// Format an event the way the drivers used to print it, without the newline
+int errlog_format(const struct errlog_event *event, char *buffer, unsigned int size);
+
+// Print the queued events to stream from a background thread every period_ms, which takes
+// the place of the messages the drivers used to print to stderr themselves
+int errlog_start_logger(FILE *stream, unsigned int period_ms);
+void errlog_stop_logger(void);
+
+
+#endif
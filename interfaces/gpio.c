@@ -1,11 +1,15 @@
+// for pthread_setaffinity_np and cpu_set_t
+#define _GNU_SOURCE
+
 #include "gpio.h"
 
-#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <fcntl.h> 
 #include <poll.h>
+#include <pthread.h>
+#include <sched.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
@@ -13,234 +17,588 @@
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 
+#include <linux/gpio.h>
+
+#include "errlog.h"
+#include "instrument.h"
+
 
 // Raspberry Pi OS memory page
 #define BLOCK_SIZE (4 * 1024)
 
-// Raspberry Pi 3 peripherals
+// Raspberry Pi 3 peripherals, used if the device tree cannot be read
 #define GPIO_PERI_BASE_2835 0x3F000000
 
-// Start of the GPIO device
-#define GPIO_BASE           (GPIO_PERI_BASE_2835 + 0x200000)
+// Offset of the GPIO device from the peripheral base
+#define GPIO_OFFSET         0x200000
+
+// Size of the RP1 GPIO map (Pi 5): IO_BANK0, SYS_RIO0, and PADS_BANK0
+#define RP1_BLOCK_SIZE      0x30000
+
+// Word offsets of the RP1 register blocks in the map
+#define RP1_IO_BANK0        (0x00000 / 4)
+#define RP1_RIO             (0x10000 / 4)
+#define RP1_PADS_BANK0      (0x20000 / 4)
+
+// Word offsets of the RP1 atomic set and clear aliases of a register block
+#define RP1_SET             (0x2000 / 4)
+#define RP1_CLR             (0x3000 / 4)
+
+// GPIO character device of the SoC's GPIO bank
+#define GPIO_CHIP           "/dev/gpiochip0"
+
+// Number of edge events the kernel queues per watched pin
+#define GPIO_EVENT_BUFFER_SIZE 128
+
+// Number of edge events fetched per read
+#define GPIO_EVENT_READ_SIZE   16
 
 // Pointer to store the map
 static volatile unsigned int* gpio;
 
-// Save if GPIO_init was already called
-static bool initCalled = false;
+// The backend GPIO_init selected
+static const struct GPIO_backend* backend;
 
 
-int GPIO_init() {
-    // Return if this function was already called
-    if (initCalled) {
-        //fputs("Warning: GPIO_init was already called before.\n", stderr);
-        return GPIO_SUCCESS;
-    }
-
+// Map the GPIO registers of a /dev/gpiomem device
+static int GPIO_map(const char* path, size_t size, off_t offset) {
     // Open the virtual GPIO interface for reading/writing, synchronize the virtual memory, set the close-on-exec flag
-    const char* path = "/dev/gpiomem";
     int fd = open(path, O_RDWR | O_SYNC | O_CLOEXEC);
 
     // If there was an error opening the interface
     if (fd < 0) {
-        fprintf(stderr, "Error opening '%s': %s (-%d).\n", path, strerror(errno), errno);
+        errlog_record_detail(ERR_GPIO_OPEN, errno, 0, path);
         return GPIO_FAILURE;
     }
 
     // Request the virtual GPIO map for reading/writing aand share the map
-    gpio = (unsigned int*)mmap(0, BLOCK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, GPIO_BASE);
+    gpio = (unsigned int*)mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
 
     // To save the return code
     int rc = GPIO_SUCCESS;
 
     // If there was an error
     if (gpio == MAP_FAILED) {
-        fprintf(stderr, "mmap error: %s (-%d).\n", strerror(errno), errno);
+        errlog_record(ERR_GPIO_MAP, errno, 0);
         rc = GPIO_FAILURE;
     }
-    else
-        // Save that this function was called
-        initCalled = true;
 
     close(fd);
 
     return rc;
 }
 
-int GPIO_setup(unsigned int pin, enum GPIO_MODE mode) {
-    switch (mode) {
-        case GPIO_IN:
-            // Reset all 3 Bits of the pin register FSELX in GPFSELX
-            *(gpio + pin / 10) = *(gpio + pin / 10) & ~(7 << (pin % 10) * 3);
-        break;
+// Read a device tree property, returns its length or -1
+static int GPIO_readDeviceTree(const char* path, unsigned char* buffer, unsigned int length) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
 
-        case GPIO_OUT:
-            // Set the Bits 001 of the pin register FSELX in GPFSELX
-            *(gpio + pin / 10) = *(gpio + pin / 10) & ~(7 << (pin % 10) * 3) | (1 << (pin % 10) * 3);
-        break;
+    int ret = read(fd, buffer, length);
+    close(fd);
 
-        default:
-            fputs("Error: Wrong mode specified. Either use GPIO_IN or GPIO_OUT.\n", stderr);
-            return GPIO_FAILURE;
+    return ret;
+}
+
+// Get the peripheral base from the device tree, the parent address has one cell on the Pi 1-3 and two on the Pi 4
+static unsigned int GPIO_peripheralBase() {
+    unsigned char ranges[12];
+    if (GPIO_readDeviceTree("/proc/device-tree/soc/ranges", ranges, sizeof(ranges)) != sizeof(ranges))
+        return GPIO_PERI_BASE_2835;
+
+    unsigned int base = ranges[4] << 24 | ranges[5] << 16 | ranges[6] << 8 | ranges[7];
+    if (base == 0)
+        base = ranges[8] << 24 | ranges[9] << 16 | ranges[10] << 8 | ranges[11];
+
+    return base;
+}
+
+// Detect the backend from the root compatible strings of the device tree
+static const struct GPIO_backend* GPIO_detect() {
+    char compatible[256];
+
+    int len = GPIO_readDeviceTree("/proc/device-tree/compatible", (unsigned char*)compatible, sizeof(compatible) - 1);
+    if (len > 0)
+        compatible[len] = '\0';
+
+    // The property is a list of NUL-terminated strings
+    for (int i = 0; i < len; i += strlen(&compatible[i]) + 1) {
+        if (strcmp(&compatible[i], "brcm,bcm2712") == 0)
+            return &GPIO_rp1Backend;
     }
 
-    return GPIO_SUCCESS;
+    return &GPIO_bcm2835Backend;
 }
 
-int GPIO_input(unsigned int pin) {
-    // Check Bit n of the GPLEV0 register
-    // If it is zero the level is low, else high
-    return (*(gpio + 13) & (1 << (pin & 31))) == 0 ? GPIO_LOW : GPIO_HIGH;
+
+static int bcm2835_init() {
+    return GPIO_map("/dev/gpiomem", BLOCK_SIZE, GPIO_peripheralBase() + GPIO_OFFSET);
 }
 
-void GPIO_output(unsigned int pin, enum GPIO_STATE state) {
-    // If GPIO_LOW  set Bit n of GPSET0 to set  GPIO pin n
-    // If GPIO_HIGH set Bit n of GPCLR0 to clear GPIO pin n
-    *(gpio + (state == GPIO_LOW ? 10 : 7)) = 1 << (pin & 31);
+static int bcm2835_setupMask(unsigned int mask, enum GPIO_MODE mode) {
+    // Each GPFSELX register holds the FSEL bits of 10 pins, pins 0-31 span GPFSEL0-GPFSEL3
+    for (unsigned int reg = 0; reg < 4; reg++) {
+        unsigned int clr = 0, set = 0;
+
+        for (unsigned int pin = reg * 10; pin < reg * 10 + 10 && pin < 32; pin++) {
+            if (!(mask & (1u << pin)))
+                continue;
+
+            // Reset all 3 Bits of the pin register FSELX, set them to 001 for an output
+            clr |= 7 << (pin % 10) * 3;
+            if (mode == GPIO_OUT)
+                set |= 1 << (pin % 10) * 3;
+        }
+
+        // One read-modify-write for all selected pins of the register
+        if (clr)
+            *(gpio + reg) = (*(gpio + reg) & ~clr) | set;
+    }
+
+    return GPIO_SUCCESS;
 }
 
-static int GPIO_export(unsigned int pin) {
-    const char* path = "/sys/class/gpio/export";
+static int bcm2835_setupMaskHigh(unsigned int mask, enum GPIO_MODE mode) {
+    // GPFSEL3-GPFSEL5 hold the pins 32-53, GPFSEL3 is shared with pins 30 and 31
+    for (unsigned int reg = 3; reg < 6; reg++) {
+        unsigned int clr = 0, set = 0;
 
-    int fd = open(path, O_WRONLY);
-    if (fd < 0) {
-        fprintf(stderr, "Error opening '%s': %s (-%d).\n", path, strerror(errno), errno);
-        return GPIO_FAILURE;
+        for (unsigned int pin = reg * 10; pin < reg * 10 + 10; pin++) {
+            if (pin < 32 || !(mask & (1u << (pin - 32))))
+                continue;
+
+            clr |= 7 << (pin % 10) * 3;
+            if (mode == GPIO_OUT)
+                set |= 1 << (pin % 10) * 3;
+        }
+
+        if (clr)
+            *(gpio + reg) = (*(gpio + reg) & ~clr) | set;
     }
 
-    char pinS[3];
-    int pinS_len = snprintf(pinS, sizeof(pinS), "%u", pin);
+    return GPIO_SUCCESS;
+}
 
-    write(fd, pinS, pinS_len);
-    close(fd);
+static unsigned int bcm2835_inputAll() {
+    // The GPLEV0 register holds the levels of pins 0-31
+    return *(gpio + 13);
+}
+
+static void bcm2835_outputMask(unsigned int set, unsigned int clr) {
+    // Write GPSET0 and GPCLR0 once each, pins not in a mask keep their level
+    if (set)
+        *(gpio + 7) = set;
+    if (clr)
+        *(gpio + 10) = clr;
+}
+
+static unsigned int bcm2835_inputAllHigh() {
+    // The GPLEV1 register holds the levels of pins 32-53
+    return *(gpio + 14) & 0x3FFFFF;
+}
+
+static void bcm2835_outputMaskHigh(unsigned int set, unsigned int clr) {
+    // Write GPSET1 and GPCLR1 once each
+    if (set)
+        *(gpio + 8) = set;
+    if (clr)
+        *(gpio + 11) = clr;
+}
+
+const struct GPIO_backend GPIO_bcm2835Backend = {
+    .pins       = 54,
+    .init       = bcm2835_init,
+    .setupMask  = bcm2835_setupMask,
+    .inputAll   = bcm2835_inputAll,
+    .outputMask = bcm2835_outputMask,
+
+    .setupMaskHigh  = bcm2835_setupMaskHigh,
+    .inputAllHigh   = bcm2835_inputAllHigh,
+    .outputMaskHigh = bcm2835_outputMaskHigh,
+};
+
+
+static int rp1_init() {
+    return GPIO_map("/dev/gpiomem0", RP1_BLOCK_SIZE, 0);
+}
+
+static int rp1_setupMask(unsigned int mask, enum GPIO_MODE mode) {
+    for (unsigned int pin = 0; pin < 28; pin++) {
+        if (!(mask & (1u << pin)))
+            continue;
+
+        // Select the SYS_RIO function (5) in GPIOX_CTRL
+        volatile unsigned int* ctrl = gpio + RP1_IO_BANK0 + pin * 2 + 1;
+        *ctrl = (*ctrl & ~0x1F) | 5;
+
+        // Enable the input and clear the output disable bit of the pad
+        volatile unsigned int* pad = gpio + RP1_PADS_BANK0 + 1 + pin;
+        *pad = (*pad & ~(1 << 7)) | (1 << 6);
+    }
+
+    // Set or clear the output enables (RIO_OE) of all pins at once
+    *(gpio + RP1_RIO + (mode == GPIO_OUT ? RP1_SET : RP1_CLR) + 1) = mask & 0x0FFFFFFF;
 
     return GPIO_SUCCESS;
 }
 
-static int GPIO_unexport(unsigned int pin) {
-    const char* path = "/sys/class/gpio/unexport";
+static unsigned int rp1_inputAll() {
+    // RIO_INPUT holds the levels of the pins
+    return *(gpio + RP1_RIO + 2);
+}
 
-    int fd = open(path, O_WRONLY);
-    if (fd < 0) {
-        fprintf(stderr, "Error opening '%s': %s (-%d).\n", path, strerror(errno), errno);
+static void rp1_outputMask(unsigned int set, unsigned int clr) {
+    // The atomic aliases of RIO_OUT change only the pins in the mask
+    if (set)
+        *(gpio + RP1_RIO + RP1_SET) = set;
+    if (clr)
+        *(gpio + RP1_RIO + RP1_CLR) = clr;
+}
+
+const struct GPIO_backend GPIO_rp1Backend = {
+    .pins       = 28,
+    .init       = rp1_init,
+    .setupMask  = rp1_setupMask,
+    .inputAll   = rp1_inputAll,
+    .outputMask = rp1_outputMask,
+};
+
+
+int GPIO_initBackend(const struct GPIO_backend* b) {
+    // Return if a backend was already initialized
+    if (backend) {
+        //fputs("Warning: GPIO_init was already called before.\n", stderr);
+        return GPIO_SUCCESS;
+    }
+
+    if (!b)
+        b = GPIO_detect();
+
+    int rc = b->init();
+    if (rc == GPIO_SUCCESS)
+        // Save that this function was called
+        backend = b;
+
+    return rc;
+}
+
+int GPIO_init() {
+    return GPIO_initBackend(NULL);
+}
+
+// Whether the backend has pin, the ones from 32 up are in its second bank
+static int GPIO_hasPin(unsigned int pin) {
+    if (pin < backend->pins && (pin < 32 || backend->setupMaskHigh))
+        return 1;
+
+    errlog_record(ERR_GPIO_PIN, 0, pin);
+    return 0;
+}
+
+int GPIO_setup(unsigned int pin, enum GPIO_MODE mode) {
+    if (pin < 32)
+        return GPIO_setupMask(1u << pin, mode);
+
+    if (!GPIO_hasPin(pin))
+        return GPIO_FAILURE;
+
+    if (mode != GPIO_IN && mode != GPIO_OUT) {
+        errlog_record(ERR_GPIO_MODE, 0, mode);
         return GPIO_FAILURE;
     }
 
-    char pinS[3];
-    int pinS_len = snprintf(pinS, sizeof(pinS), "%u", pin);
+    return backend->setupMaskHigh(1u << (pin - 32), mode);
+}
+
+int GPIO_input(unsigned int pin) {
+    // Check Bit n of the levels of the pin's bank
+    // If it is zero the level is low, else high
+    if (pin < 32)
+        return (backend->inputAll() & (1u << pin)) == 0 ? GPIO_LOW : GPIO_HIGH;
 
-    write(fd, pinS, pinS_len);
-    close(fd);
+    if (!GPIO_hasPin(pin))
+        return GPIO_FAILURE;
 
-    return GPIO_SUCCESS;
+    return (backend->inputAllHigh() & (1u << (pin - 32))) == 0 ? GPIO_LOW : GPIO_HIGH;
 }
 
-static int GPIO_writeFile(unsigned int pin, char* file, char* input, unsigned int input_len) {
-    char path[64];
-    snprintf(path, sizeof(path), "/sys/class/gpio/gpio%u/%s", pin, file);
+void GPIO_output(unsigned int pin, enum GPIO_STATE state) {
+    void (*output)(unsigned int, unsigned int) = backend->outputMask;
 
-    struct timespec start, test;
-    clock_gettime(CLOCK_REALTIME, &start);
+    if (pin >= 32) {
+        if (!GPIO_hasPin(pin))
+            return;
 
-    int fd = open(path, O_WRONLY);
-    while (fd == -1) {
-        clock_gettime(CLOCK_REALTIME, &test);
-        if (((test.tv_sec - start.tv_sec) * 1e3 + (test.tv_nsec - start.tv_nsec) / 1e6) >= 100) {
-            fprintf(stderr, "Error opening '%s': %s (-%d).\n", path, strerror(errno), errno);
-            return GPIO_FAILURE;
-        }
+        output = backend->outputMaskHigh;
+        pin -= 32;
+    }
 
-        fd = open(path, O_WRONLY); 
+    if (state == GPIO_LOW)
+        output(0, 1u << pin);
+    else
+        output(1u << pin, 0);
+}
+
+int GPIO_setupMask(unsigned int mask, enum GPIO_MODE mode) {
+    if (mode != GPIO_IN && mode != GPIO_OUT) {
+        errlog_record(ERR_GPIO_MODE, 0, mode);
+        return GPIO_FAILURE;
     }
 
-    write(fd, input, input_len);
-    close(fd);
+    return backend->setupMask(mask, mode);
+}
 
-    return GPIO_SUCCESS;
+unsigned int GPIO_inputAll() {
+    return backend->inputAll();
 }
 
-static int GPIO_pollValue(unsigned int pin, int timeout) {
-    char path[64];
-    snprintf(path, sizeof(path), "/sys/class/gpio/gpio%u/value", pin);
+void GPIO_outputMask(unsigned int set, unsigned int clr) {
+    backend->outputMask(set, clr);
+}
 
-    struct timespec start, test;
-    clock_gettime(CLOCK_REALTIME, &start);
+int GPIO_watchEdges(unsigned int pin, enum GPIO_EDGE edge) {
+    struct gpio_v2_line_request req;
+    memset(&req, 0, sizeof(req));
+
+    switch (edge) {
+        case GPIO_FALLING: req.config.flags = GPIO_V2_LINE_FLAG_EDGE_FALLING; break;
+        case GPIO_RISING:  req.config.flags = GPIO_V2_LINE_FLAG_EDGE_RISING;  break;
+        case GPIO_BOTH:    req.config.flags = GPIO_V2_LINE_FLAG_EDGE_FALLING | GPIO_V2_LINE_FLAG_EDGE_RISING; break;
 
-    int fd = open(path, O_RDONLY);
-    while (fd == -1) {
-        clock_gettime(CLOCK_REALTIME, &test);
-        if (((test.tv_sec - start.tv_sec) * 1e3 + (test.tv_nsec - start.tv_nsec) / 1e6) >= 100) {
-            fprintf(stderr, "Error opening '%s': %s (-%d).\n", path, strerror(errno), errno);
+        default:
+            errlog_record(ERR_GPIO_EDGE, 0, edge);
             return GPIO_FAILURE;
-        }
+    }
 
-        fd = open(path, O_RDONLY); 
+    const char* path = GPIO_CHIP;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        errlog_record_detail(ERR_GPIO_OPEN, errno, 0, path);
+        return GPIO_FAILURE;
     }
 
-    char c;
-    read(fd, &c, 1);
+    // Request the pin as an input line, the kernel queues its edges with timestamps until they are read
+    req.offsets[0] = pin;
+    req.num_lines = 1;
+    req.config.flags |= GPIO_V2_LINE_FLAG_INPUT;
+    req.event_buffer_size = GPIO_EVENT_BUFFER_SIZE;
+    strncpy(req.consumer, "raspberry-periphery", sizeof(req.consumer) - 1);
+
+    int rc = ioctl(fd, GPIO_V2_GET_LINE_IOCTL, &req);
+    if (rc == -1)
+        errlog_record(ERR_GPIO_REQUEST, errno, pin);
 
+    // The line stays requested through its own file descriptor
+    close(fd);
+
+    return rc == -1 ? GPIO_FAILURE : req.fd;
+}
+
+int GPIO_readEdges(int fd, struct GPIO_edgeEvent* events, unsigned int max, int timeout) {
     struct pollfd p;
     p.fd = fd;
-    p.events = POLLPRI | POLLERR;
+    p.events = POLLIN;
 
     int ret = poll(&p, 1, timeout);
-    if (ret == -1)
-        fprintf(stderr, "Error opening '%s': %s (-%d).\n", path, strerror(errno), errno);
-
-    close(fd);
+    if (ret == -1) {
+        errlog_record(ERR_GPIO_POLL, errno, 0);
+        return GPIO_FAILURE;
+    }
 
-    return ret;
-}
+    if (ret == 0)
+        return 0;
 
-int GPIO_waitForEdge(unsigned int pin, enum GPIO_EDGE edge, int timeout) {
-    char* edgeS;
+    // Read the queued events, at most max of them
+    struct gpio_v2_line_event buff[GPIO_EVENT_READ_SIZE];
+    unsigned int n = max < GPIO_EVENT_READ_SIZE ? max : GPIO_EVENT_READ_SIZE;
 
-    switch (edge) {
-        case GPIO_FALLING: edgeS = "falling"; break;
-        case GPIO_RISING:  edgeS = "rising";  break;
-        case GPIO_BOTH:    edgeS = "both";    break;
+    ret = read(fd, buff, n * sizeof(*buff));
+    if (ret == -1) {
+        errlog_record(ERR_GPIO_READ, errno, 0);
+        return GPIO_FAILURE;
+    }
 
-        default:
-            fputs("Error: Wrong edge specified. Either use GPIO_FALLING, GPIO_RISING or GPIO_BOTH.\n", stderr);
-            return GPIO_FAILURE;
+    n = ret / sizeof(*buff);
+    for (unsigned int i = 0; i < n; i++) {
+        events[i].timestamp_ns = buff[i].timestamp_ns;
+        events[i].edge = buff[i].id == GPIO_V2_LINE_EVENT_RISING_EDGE ? GPIO_RISING : GPIO_FALLING;
     }
 
-    int rc = GPIO_export(pin);
-    if (rc != GPIO_SUCCESS)
-        return rc;
+    return n;
+}
+
+int GPIO_unwatchEdges(int fd) {
+    int ret = close(fd);
+    if (ret == -1)
+        errlog_record(ERR_GPIO_UNWATCH, errno, 0);
 
-    rc = GPIO_writeFile(pin, "direction", "in", 2);
-    if (rc != GPIO_SUCCESS)
-        goto GPIO_unexport;
+    return ret == -1 ? GPIO_FAILURE : GPIO_SUCCESS;
+}
 
-    rc = GPIO_writeFile(pin, "edge", edgeS, strlen(edgeS));
-    if (rc != GPIO_SUCCESS)
-        goto GPIO_unexport;
+int GPIO_waitForEdge(unsigned int pin, enum GPIO_EDGE edge, int timeout) {
+    int fd = GPIO_watchEdges(pin, edge);
+    if (fd == GPIO_FAILURE)
+        return GPIO_FAILURE;
 
-    rc = GPIO_pollValue(pin, timeout);
+    struct GPIO_edgeEvent event;
+    int rc = GPIO_readEdges(fd, &event, 1, timeout);
 
-GPIO_unexport:
-    GPIO_unexport(pin);
+    GPIO_unwatchEdges(fd);
 
     return rc;
 }
 
 int GPIO_pollForState(unsigned int pin, enum GPIO_STATE state, unsigned int timeout) {
+    // CLOCK_MONOTONIC_RAW is neither stepped nor slewed by NTP while measuring
     struct timespec start, test;
-	clock_gettime(CLOCK_REALTIME, &start);
-    //test = start;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    test = start;
 
-    while (GPIO_input(pin) != state) {
-        clock_gettime(CLOCK_REALTIME, &test);
+    while (GPIO_input(pin) != (int)state) {
+        clock_gettime(CLOCK_MONOTONIC_RAW, &test);
 
-        if (((test.tv_sec - start.tv_sec) * 1e6 + (test.tv_nsec - start.tv_nsec) / 1e3) >= timeout)
+        if (((test.tv_sec - start.tv_sec) * 1e6 + (test.tv_nsec - start.tv_nsec) / 1e3) >= timeout) {
+            INSTR_RECORD(INSTR_GPIO_POLL, (test.tv_sec - start.tv_sec) * 1000000000ULL + (test.tv_nsec - start.tv_nsec), 0);
             return GPIO_FAILURE;
+        }
     }
 
+    // the poll already measures its duration, so it is recorded without reading the clock again
+    INSTR_RECORD(INSTR_GPIO_POLL, (test.tv_sec - start.tv_sec) * 1000000000ULL + (test.tv_nsec - start.tv_nsec), 1);
+
     return (test.tv_sec - start.tv_sec) * 1e6 + (test.tv_nsec - start.tv_nsec) / 1e3;
 }
 
+static void* GPIO_samplerThread(void* arg) {
+    struct GPIO_sampler* sampler = arg;
+    unsigned int (*source)() = sampler->source;
+    if (!source)
+        source = sampler->pin < 32 ? backend->inputAll : backend->inputAllHigh;
+
+    // Best effort, the sampling still runs without the privileges
+    int pinned = 0;
+    if (sampler->cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(sampler->cpu, &cpus);
+
+        pinned = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+    }
+
+    // A SCHED_FIFO spinner on an arbitrary core could starve the thread that waits for it
+    if (sampler->realtime && pinned) {
+        const struct sched_param param = { .sched_priority = sched_get_priority_max(SCHED_FIFO) };
+        pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    }
+
+    struct timespec start, test;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+
+    // The bit of the pin in the levels of its bank
+    const unsigned int bit = 1u << (sampler->pin & 31);
+    unsigned int word = 0, level = 0;
+
+    // How late the release was, the samples after it are shifted by that
+    unsigned long long shift = 0;
+
+    sampler->missed = 0;
+
+    for (unsigned int i = 0; i < sampler->count; i++) {
+        // Spin until the sample is due
+        unsigned long long due = (unsigned long long)i * sampler->period_ns + shift, now;
+        do {
+            clock_gettime(CLOCK_MONOTONIC_RAW, &test);
+            now = (test.tv_sec - start.tv_sec) * 1000000000ULL + test.tv_nsec - start.tv_nsec;
+        } while (now < due);
+
+        if ((int)i == sampler->release) {
+            GPIO_output(sampler->pin, GPIO_HIGH);
+            GPIO_setup(sampler->pin, GPIO_IN);
+
+            shift += now - due;
+            due = now;
+        }
+
+        // A sample more than one period late was missed, it repeats the previous level to keep the timing
+        if (now - due < sampler->period_ns)
+            level = source() & bit;
+        else
+            sampler->missed++;
+
+        if (level)
+            word |= 1u << (i % 32);
+
+        if (i % 32 == 31 || i == sampler->count - 1) {
+            sampler->samples[i / 32] = word;
+            word = 0;
+        }
+    }
+
+    return NULL;
+}
+
+int GPIO_samplerStart(struct GPIO_sampler* sampler) {
+    if (!GPIO_hasPin(sampler->pin))
+        return GPIO_FAILURE;
+
+    int rc = pthread_create(&sampler->thread, NULL, GPIO_samplerThread, sampler);
+    if (rc != 0) {
+        errlog_record(ERR_GPIO_SAMPLER_START, rc, 0);
+        return GPIO_FAILURE;
+    }
+
+    return GPIO_SUCCESS;
+}
+
+int GPIO_samplerWait(struct GPIO_sampler* sampler) {
+    int rc = pthread_join(sampler->thread, NULL);
+    if (rc != 0) {
+        errlog_record(ERR_GPIO_SAMPLER_JOIN, rc, 0);
+        return GPIO_FAILURE;
+    }
+
+    return GPIO_SUCCESS;
+}
+
+int GPIO_samplerRuns(const struct GPIO_sampler* sampler, unsigned int* runs, unsigned int max, enum GPIO_STATE* first) {
+    const unsigned int words = (sampler->count + 31) / 32;
+    unsigned int n = 0, last = 0;
+
+    *first = sampler->count && (sampler->samples[0] & 1) ? GPIO_HIGH : GPIO_LOW;
+
+    // Find the level changes 32 samples at a time: bit i of x is set if sample i differs from sample i - 1
+    unsigned int prev = *first == GPIO_HIGH ? 1 : 0;
+    for (unsigned int w = 0; w < words; w++) {
+        unsigned int cur = sampler->samples[w];
+        unsigned int x = cur ^ (cur << 1 | prev);
+
+        // The bits after the last sample are not samples
+        if (w == words - 1 && sampler->count % 32)
+            x &= (1u << sampler->count % 32) - 1;
+
+        while (x) {
+            unsigned int i = w * 32 + __builtin_ctz(x);
+            if (n == max)
+                return GPIO_FAILURE;
+
+            runs[n++] = i - last;
+            last = i;
+
+            x &= x - 1;
+        }
+
+        prev = cur >> 31;
+    }
+
+    // The last run is cut off by the end of the capture
+    if (n == max)
+        return GPIO_FAILURE;
+
+    runs[n++] = sampler->count - last;
+
+    return n;
+}
+
 /*unsigned int msleep(unsigned int ms) {
     struct timespec req, rem;
     req.tv_sec  =  ms / 1000;
@@ -1,6 +1,8 @@
 #ifndef INTERFACES_GPIO_H
 #define INTERFACES_GPIO_H
 
+#include <pthread.h>
+
 
 #define GPIO_INFINITE_TIMEOUT -1
 
@@ -25,15 +27,88 @@ enum GPIO_EDGE {
     GPIO_BOTH
 };
 
+// An edge reported by the kernel, timestamped with CLOCK_MONOTONIC
+struct GPIO_edgeEvent {
+    unsigned long long timestamp_ns;
+    enum GPIO_EDGE edge;
+};
+
+// The register accesses behind GPIO_setup, GPIO_input, GPIO_output, and their mask variants
+struct GPIO_backend {
+    // the number of pins, from pin 0 up
+    unsigned int pins;
+
+    int (*init)();
+
+    int (*setupMask)(unsigned int mask, enum GPIO_MODE mode);
+    unsigned int (*inputAll)();
+    void (*outputMask)(unsigned int set, unsigned int clr);
+
+    // the same for the second bank, bit n is pin 32 + n; NULL if the backend has no pins from 32 up
+    int (*setupMaskHigh)(unsigned int mask, enum GPIO_MODE mode);
+    unsigned int (*inputAllHigh)();
+    void (*outputMaskHigh)(unsigned int set, unsigned int clr);
+};
+
+// BCM2835/6/7 and BCM2711 GPIO through /dev/gpiomem (Pi 1-4)
+extern const struct GPIO_backend GPIO_bcm2835Backend;
+// RP1 GPIO through /dev/gpiomem0 (Pi 5)
+extern const struct GPIO_backend GPIO_rp1Backend;
+
+// Samples the level of a pin at a fixed rate from a dedicated thread
+struct GPIO_sampler {
+    unsigned int pin;
+    unsigned int period_ns;
+
+    // the core to pin the thread to, -1 for none
+    int cpu;
+    // run the thread as SCHED_FIFO once it is pinned to cpu, it then starves other threads on that core
+    int realtime;
+    // reads the levels of the bank of pin (pins 0-31 or 32-63), NULL reads them from the backend
+    unsigned int (*source)();
+
+    // the sample at which the thread drives the pin high and switches it to an input, -1 for none;
+    // the samples after it are timed from the release, so a late release does not shorten them
+    int release;
+
+    // count samples, sample i is bit i % 32 of samples[i / 32]
+    unsigned int* samples;
+    unsigned int count;
+
+    // the samples taken too late, they repeat the previous level
+    unsigned int missed;
+
+    pthread_t thread;
+};
+
 
+// Initialize a backend, NULL detects the SoC from the device tree; only the first call has an effect
+int GPIO_initBackend(const struct GPIO_backend* backend);
 int GPIO_init();
 int GPIO_setup(unsigned int pin, enum GPIO_MODE mode);
 int GPIO_input(unsigned int pin);
 void GPIO_output(unsigned int pin, enum GPIO_STATE state);
 
+// Access pins 0-31 at once, bit n of a mask is pin n
+int GPIO_setupMask(unsigned int mask, enum GPIO_MODE mode);
+unsigned int GPIO_inputAll();
+void GPIO_outputMask(unsigned int set, unsigned int clr);
+
+// Watch a pin for edges, the returned file descriptor can be added to poll/epoll
+int GPIO_watchEdges(unsigned int pin, enum GPIO_EDGE edge);
+
+// Read up to max queued edges, waits up to timeout ms for the first one and returns the count
+int GPIO_readEdges(int fd, struct GPIO_edgeEvent* events, unsigned int max, int timeout);
+int GPIO_unwatchEdges(int fd);
+
 int GPIO_waitForEdge(unsigned int pin, enum GPIO_EDGE edge, int timeout);
 int GPIO_pollForState(unsigned int pin, enum GPIO_STATE state, unsigned int timeout);
 
+int GPIO_samplerStart(struct GPIO_sampler* sampler);
+int GPIO_samplerWait(struct GPIO_sampler* sampler);
+// Get the lengths of the runs of equal samples, alternating levels starting with first, returns their count
+int GPIO_samplerRuns(const struct GPIO_sampler* sampler, unsigned int* runs, unsigned int max, enum GPIO_STATE* first);
+
 //unsigned int msleep(unsigned int ms);
 
 
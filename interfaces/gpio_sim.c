@@ -0,0 +1,146 @@
+#include "gpio_sim.h"
+
+#include <time.h>
+
+
+// A scripted waveform and when it was started
+struct sim_script {
+    const struct GPIO_simStep* steps;
+    unsigned int count;
+
+    struct timespec start;
+};
+
+// Like the BCM2835: pins 0-31 in the first bank, 32-53 in the second
+#define SIM_PINS    54
+
+static unsigned int outputs[2];
+static unsigned int levels[2];
+static struct sim_script scripts[SIM_PINS];
+
+static unsigned long accesses;
+
+
+// Get the level of a scripted input, the last step's level holds after the waveform ended
+static unsigned int sim_scriptLevel(const struct sim_script* script, const struct timespec* now) {
+    unsigned long long elapsed = (now->tv_sec - script->start.tv_sec) * 1000000ULL +
+        (now->tv_nsec - script->start.tv_nsec) / 1000;
+
+    for (unsigned int i = 0; i < script->count; i++) {
+        if (elapsed < script->steps[i].duration_us)
+            return script->steps[i].state;
+
+        elapsed -= script->steps[i].duration_us;
+    }
+
+    return script->steps[script->count - 1].state;
+}
+
+void GPIO_simScript(unsigned int pin, const struct GPIO_simStep* steps, unsigned int count) {
+    if (pin >= SIM_PINS)
+        return;
+
+    scripts[pin].steps = count ? steps : NULL;
+    scripts[pin].count = count;
+}
+
+unsigned long GPIO_simAccesses() {
+    return accesses;
+}
+
+void GPIO_simReset() {
+    for (int bank = 0; bank < 2; bank++) {
+        outputs[bank] = 0;
+        levels[bank]  = 0;
+    }
+    accesses = 0;
+
+    for (int pin = 0; pin < SIM_PINS; pin++)
+        scripts[pin].steps = NULL;
+}
+
+
+static int sim_init() {
+    return GPIO_SUCCESS;
+}
+
+static int sim_setupBank(unsigned int bank, unsigned int mask, enum GPIO_MODE mode) {
+    accesses++;
+
+    if (mode == GPIO_OUT) {
+        outputs[bank] |= mask;
+        return GPIO_SUCCESS;
+    }
+
+    // Releasing a scripted pin starts its waveform
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+
+    for (unsigned int bit = 0; bit < 32 && bank * 32 + bit < SIM_PINS; bit++)
+        if (mask & outputs[bank] & (1u << bit))
+            scripts[bank * 32 + bit].start = now;
+
+    outputs[bank] &= ~mask;
+
+    return GPIO_SUCCESS;
+}
+
+static unsigned int sim_inputBank(unsigned int bank) {
+    accesses++;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+
+    // Outputs read back their level, idle inputs are pulled up
+    unsigned int all = (levels[bank] & outputs[bank]) | ~outputs[bank];
+
+    for (unsigned int bit = 0; bit < 32 && bank * 32 + bit < SIM_PINS; bit++) {
+        const struct sim_script* script = &scripts[bank * 32 + bit];
+        if (!(outputs[bank] & (1u << bit)) && script->steps && !sim_scriptLevel(script, &now))
+            all &= ~(1u << bit);
+    }
+
+    return all;
+}
+
+static void sim_outputBank(unsigned int bank, unsigned int set, unsigned int clr) {
+    accesses++;
+
+    levels[bank] = (levels[bank] | set) & ~clr;
+}
+
+static int sim_setupMask(unsigned int mask, enum GPIO_MODE mode) {
+    return sim_setupBank(0, mask, mode);
+}
+
+static unsigned int sim_inputAll() {
+    return sim_inputBank(0);
+}
+
+static void sim_outputMask(unsigned int set, unsigned int clr) {
+    sim_outputBank(0, set, clr);
+}
+
+static int sim_setupMaskHigh(unsigned int mask, enum GPIO_MODE mode) {
+    return sim_setupBank(1, mask, mode);
+}
+
+static unsigned int sim_inputAllHigh() {
+    return sim_inputBank(1);
+}
+
+static void sim_outputMaskHigh(unsigned int set, unsigned int clr) {
+    sim_outputBank(1, set, clr);
+}
+
+const struct GPIO_backend GPIO_simBackend = {
+    .pins       = SIM_PINS,
+    .init       = sim_init,
+    .setupMask  = sim_setupMask,
+    .inputAll   = sim_inputAll,
+    .outputMask = sim_outputMask,
+
+    .setupMaskHigh  = sim_setupMaskHigh,
+    .inputAllHigh   = sim_inputAllHigh,
+    .outputMaskHigh = sim_outputMaskHigh,
+};
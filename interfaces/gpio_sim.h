@@ -0,0 +1,27 @@
+#ifndef INTERFACES_GPIO_SIM_H
+#define INTERFACES_GPIO_SIM_H
+
+#include "gpio.h"
+
+
+// One step of a scripted input waveform
+struct GPIO_simStep {
+    unsigned int duration_us;
+    enum GPIO_STATE state;
+};
+
+// An in-memory GPIO block for pins 0-53 in two banks like the BCM2835's, inputs idle high (pull-up)
+// unless scripted
+extern const struct GPIO_backend GPIO_simBackend;
+
+// Play the waveform on pin every time it is switched to an input, steps must stay valid; NULL removes it
+void GPIO_simScript(unsigned int pin, const struct GPIO_simStep* steps, unsigned int count);
+
+// Get the number of register accesses since the last GPIO_simReset
+unsigned long GPIO_simAccesses();
+
+// Reset all pins to idle inputs, remove the scripts, and reset the access counter
+void GPIO_simReset();
+
+
+#endif
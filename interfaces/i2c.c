@@ -8,83 +8,259 @@
 #include <unistd.h>
 #include <sys/ioctl.h>
 
-#define I2C_FILE    "/dev/i2c-1"
-#define I2C_SLAVE   0x0703
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
 
+#include "errlog.h"
+#include "instrument.h"
 
-int i2c_open(int dev_id) {
-    int fd = open(I2C_FILE, O_RDWR);
-	if (fd == -1) {
-		fprintf(stderr, "Error opening I²C %s: %s (-%d).\n",
-            I2C_FILE, strerror(errno), errno);
+#define I2C_FILE        "/dev/i2c-%d"
+
+#define I2C_MAX_BUSES   8
+#define I2C_MAX_HANDLES 32
+
+
+// An I²C bus, shared by all handles of the devices on it
+struct linux_bus {
+    int fd;
+    unsigned int users;
+
+    // the slave address last selected with I2C_SLAVE, -1 if unknown
+    int slave;
+};
+
+// A device on a bus, returned to the caller as its index
+struct linux_handle {
+    int bus;
+    int dev_id;
+    int used;
+};
+
+static struct linux_bus buses[I2C_MAX_BUSES];
+static struct linux_handle handles[I2C_MAX_HANDLES];
+
+
+static struct linux_handle* get_handle(int handle) {
+    if (handle < 0 || handle >= I2C_MAX_HANDLES || !handles[handle].used) {
+        errlog_record(ERR_I2C_HANDLE, 0, handle);
+        return NULL;
+    }
+
+    return &handles[handle];
+}
+
+// Select the slave address for write(), skipping the ioctl if it is already selected
+static int select_slave(struct linux_bus* bus, int dev_id) {
+    if (bus->slave == dev_id)
+        return 0;
+
+    INSTR_START(start);
+    int ret = ioctl(bus->fd, I2C_SLAVE, dev_id);
+    INSTR_END(INSTR_I2C_IOCTL, start, ret != -1);
+
+    if (ret == -1) {
+        errlog_record(ERR_I2C_SELECT, errno, dev_id);
+        bus->slave = -1;
 
         return -1;
-	}
+    }
 
-	if (ioctl(fd, I2C_SLAVE, dev_id) == -1) {
-		fprintf(stderr, "Error selecting I²C device 0x%X: %s (-%d).\n",
-            dev_id, strerror(errno), errno);
-        close(fd);
+    bus->slave = dev_id;
 
-		return -1;
-	}
+    return 0;
+}
 
-    return fd;
+static int linux_open(int bus_id, int dev_id) {
+    if (bus_id < 0 || bus_id >= I2C_MAX_BUSES) {
+        errlog_record(ERR_I2C_BUS, 0, bus_id);
+        return -1;
+    }
+
+    int handle = 0;
+    while (handle < I2C_MAX_HANDLES && handles[handle].used)
+        handle++;
+
+    if (handle == I2C_MAX_HANDLES) {
+        errlog_record(ERR_I2C_FULL, 0, dev_id);
+        return -1;
+    }
+
+    struct linux_bus* bus = &buses[bus_id];
+
+    // Open the bus for its first device only
+    if (bus->users == 0) {
+        char path[16];
+        snprintf(path, sizeof(path), I2C_FILE, bus_id);
+
+        bus->fd = open(path, O_RDWR);
+        if (bus->fd == -1) {
+            errlog_record_detail(ERR_I2C_OPEN, errno, bus_id, path);
+
+            return -1;
+        }
+
+        bus->slave = -1;
+    }
+
+    bus->users++;
+
+    if (select_slave(bus, dev_id) == -1) {
+        if (--bus->users == 0)
+            close(bus->fd);
+
+        return -1;
+    }
+
+    handles[handle].bus    = bus_id;
+    handles[handle].dev_id = dev_id;
+    handles[handle].used   = 1;
+
+    return handle;
 }
 
-int i2c_close(int fd) {
-    int ret = close(fd);
+static int linux_close(int handle) {
+    struct linux_handle* h = get_handle(handle);
+    if (!h)
+        return -1;
+
+    h->used = 0;
+
+    // Close the bus with its last device
+    struct linux_bus* bus = &buses[h->bus];
+    if (--bus->users > 0)
+        return 0;
+
+    int ret = close(bus->fd);
     if (ret == -1)
-        fprintf(stderr, "Error closing I²C: %s (-%d).\n",
-            strerror(errno), errno);
+        errlog_record(ERR_I2C_CLOSE, errno, 0);
 
     return ret;
 }
 
 
-int i2c_read(int fd, unsigned char addr) {
-    unsigned char b = 0;
-
-    if (write(fd, &addr, 1) == -1) {
-		fprintf(stderr, "Error selecting I²C address 0x%x: %s (-%d).\n",
-            addr, strerror(errno), errno);
+static int linux_read_segments(int handle, const struct i2c_segment* segments, unsigned int count) {
+    struct linux_handle* h = get_handle(handle);
+    if (!h)
+        return -1;
 
+    if (count > I2C_MAX_SEGMENTS) {
+        errlog_record(ERR_I2C_SEGMENTS, 0, count);
         return -1;
     }
 
-    if (read(fd, &b, 1) == -1) {
-		fprintf(stderr, "Error reading from I²C address 0x%x: %s (-%d).\n",
-            addr, strerror(errno), errno);
+    // Each segment is the register address write followed by the data read with a repeated start,
+    // the slave address is part of every message so I2C_SLAVE is not needed
+    struct i2c_msg msgs[2 * I2C_MAX_SEGMENTS];
+    unsigned char addrs[I2C_MAX_SEGMENTS];
 
+    for (unsigned int i = 0; i < count; i++) {
+        addrs[i] = segments[i].addr;
+
+        msgs[2 * i].addr  = h->dev_id;
+        msgs[2 * i].flags = 0;
+        msgs[2 * i].len   = 1;
+        msgs[2 * i].buf   = &addrs[i];
+
+        msgs[2 * i + 1].addr  = h->dev_id;
+        msgs[2 * i + 1].flags = I2C_M_RD;
+        msgs[2 * i + 1].len   = segments[i].length;
+        msgs[2 * i + 1].buf   = segments[i].buffer;
+    }
+
+    struct i2c_rdwr_ioctl_data data = { .msgs = msgs, .nmsgs = 2 * count };
+
+    // the ioctl returns the number of messages, two per segment
+    if (ioctl(buses[h->bus].fd, I2C_RDWR, &data) == -1) {
+        errlog_record(ERR_I2C_READ, errno, segments[0].addr);
         return -1;
     }
 
-    return b;
+    return count;
 }
 
-int i2c_read_block(int fd, unsigned char addr, unsigned char* buffer, unsigned int length) {
-    if (write(fd, &addr, 1) == -1) {
-		fprintf(stderr, "Error selecting I²C address 0x%x: %s (-%d).\n",
-            addr, strerror(errno), errno);
+static int linux_read_block(int handle, unsigned char addr, unsigned char* buffer, unsigned int length) {
+    const struct i2c_segment segment = { addr, buffer, length };
 
+    return linux_read_segments(handle, &segment, 1) == -1 ? -1 : (int)length;
+}
+
+static int linux_write(int handle, unsigned char addr, unsigned char data) {
+    struct linux_handle* h = get_handle(handle);
+    if (!h)
         return -1;
-    }
 
-    int ret = read(fd, buffer, length);
+    struct linux_bus* bus = &buses[h->bus];
+    if (select_slave(bus, h->dev_id) == -1)
+        return -1;
+
+    const unsigned char buff[] = { addr, data };
+
+    int ret = write(bus->fd, buff, sizeof(buff));
     if (ret == -1)
-		fprintf(stderr, "Error reading from I²C address 0x%x: %s (-%d).\n",
-            addr, strerror(errno), errno);
+        errlog_record(ERR_I2C_WRITE, errno, addr);
 
     return ret;
 }
 
-int i2c_write(int fd, unsigned char addr, unsigned char data) {
-    const unsigned char buff[] = { addr, data };
+const struct i2c_transport i2c_linux_transport = {
+    .open          = linux_open,
+    .close         = linux_close,
+    .read_block    = linux_read_block,
+    .read_segments = linux_read_segments,
+    .write         = linux_write,
+};
 
-    int ret = write(fd, buff, sizeof(buff));
-    if (ret == -1)
-		fprintf(stderr, "Error writing to I²C address 0x%x: %s (-%d).\n",
-            addr, strerror(errno), errno);
+// The transport used by the i2c_* functions
+static const struct i2c_transport* transport = &i2c_linux_transport;
+
+void i2c_set_transport(const struct i2c_transport* t) {
+    transport = t ? t : &i2c_linux_transport;
+}
+
+
+int i2c_open(int dev_id) {
+    return transport->open(I2C_DEFAULT_BUS, dev_id);
+}
+
+int i2c_open_bus(int bus, int dev_id) {
+    return transport->open(bus, dev_id);
+}
+
+int i2c_close(int fd) {
+    return transport->close(fd);
+}
+
+
+int i2c_read(int fd, unsigned char addr) {
+    unsigned char b = 0;
+
+    INSTR_START(start);
+    int ret = transport->read_block(fd, addr, &b, 1);
+    INSTR_END(INSTR_I2C_READ, start, ret != -1);
+
+    return ret == -1 ? -1 : b;
+}
+
+int i2c_read_block(int fd, unsigned char addr, unsigned char* buffer, unsigned int length) {
+    INSTR_START(start);
+    int ret = transport->read_block(fd, addr, buffer, length);
+    INSTR_END(INSTR_I2C_READ, start, ret != -1);
+
+    return ret;
+}
+
+int i2c_read_segments(int fd, const struct i2c_segment* segments, unsigned int count) {
+    INSTR_START(start);
+    int ret = transport->read_segments(fd, segments, count);
+    INSTR_END(INSTR_I2C_READ, start, ret != -1);
+
+    return ret;
+}
+
+int i2c_write(int fd, unsigned char addr, unsigned char data) {
+    INSTR_START(start);
+    int ret = transport->write(fd, addr, data);
+    INSTR_END(INSTR_I2C_WRITE, start, ret != -1);
 
     return ret;
 }
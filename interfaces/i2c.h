@@ -2,11 +2,47 @@
 #define INTERFACES_I2C_H
 
 
+// The bus used by i2c_open (/dev/i2c-1)
+#define I2C_DEFAULT_BUS 1
+
+// The maximum number of segments in one i2c_read_segments call
+#define I2C_MAX_SEGMENTS 21
+
+// One register read of a combined transaction
+struct i2c_segment {
+    unsigned char addr;
+    unsigned char* buffer;
+    unsigned int length;
+};
+
+// The functions behind i2c_open, i2c_close, i2c_read_block, i2c_read_segments, and i2c_write
+struct i2c_transport {
+    int (*open)(int bus, int dev_id);
+    int (*close)(int fd);
+
+    int (*read_block)(int fd, unsigned char addr, unsigned char* buffer, unsigned int length);
+    int (*read_segments)(int fd, const struct i2c_segment* segments, unsigned int count);
+    int (*write)(int fd, unsigned char addr, unsigned char data);
+};
+
+// The Linux I²C character device transport (default)
+extern const struct i2c_transport i2c_linux_transport;
+
+// Select the transport used by all following calls, NULL restores the default
+void i2c_set_transport(const struct i2c_transport* transport);
+
+
+// Open a device on a bus, devices on the same bus share one file descriptor
 int i2c_open(int dev_id);
+int i2c_open_bus(int bus, int dev_id);
 int i2c_close(int fd);
 
 int i2c_read(int fd, unsigned char addr);
 int i2c_read_block(int fd, unsigned char addr, unsigned char* buffer, unsigned int length);
+
+// Read several register blocks in one transaction with repeated starts in between, returns count
+int i2c_read_segments(int fd, const struct i2c_segment* segments, unsigned int count);
+
 int i2c_write(int fd, unsigned char addr, unsigned char data);
 
 
@@ -0,0 +1,169 @@
+#include "i2c_sim.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#include "errlog.h"
+
+
+// A simulated device on the bus
+struct sim_device {
+    int bus;
+    int dev_id;
+    unsigned char regs[256];
+};
+
+static struct sim_device devices[I2C_SIM_MAX_DEVICES];
+static unsigned int device_count;
+
+static unsigned int latency;
+static unsigned long transactions;
+static unsigned long bytes;
+
+
+static struct sim_device* find_device(int bus, int dev_id) {
+    for (unsigned int i = 0; i < device_count; i++)
+        if (devices[i].bus == bus && devices[i].dev_id == dev_id)
+            return &devices[i];
+
+    return NULL;
+}
+
+// Count the transaction and its bytes, and wait for the configured bus latency
+static void transaction(unsigned int length) {
+    transactions++;
+    bytes += length;
+
+    if (latency)
+        usleep(latency);
+}
+
+
+int i2c_sim_add_device(int bus, int dev_id, const unsigned char* regs) {
+    struct sim_device* dev = find_device(bus, dev_id);
+    if (!dev) {
+        if (device_count == I2C_SIM_MAX_DEVICES) {
+            errlog_record(ERR_I2C_SIM_FULL, 0, dev_id);
+            return -1;
+        }
+
+        dev = &devices[device_count++];
+        dev->bus    = bus;
+        dev->dev_id = dev_id;
+    }
+
+    if (regs)
+        memcpy(dev->regs, regs, sizeof(dev->regs));
+    else
+        memset(dev->regs, 0, sizeof(dev->regs));
+
+    return 0;
+}
+
+unsigned char* i2c_sim_registers(int bus, int dev_id) {
+    struct sim_device* dev = find_device(bus, dev_id);
+
+    return dev ? dev->regs : NULL;
+}
+
+void i2c_sim_set_latency(unsigned int latency_us) {
+    latency = latency_us;
+}
+
+unsigned long i2c_sim_transactions(void) {
+    return transactions;
+}
+
+unsigned long i2c_sim_bytes(void) {
+    return bytes;
+}
+
+void i2c_sim_reset(void) {
+    device_count = 0;
+    latency      = 0;
+    transactions = 0;
+    bytes        = 0;
+}
+
+
+// The file descriptor is the index of the device in the table
+static int sim_open(int bus, int dev_id) {
+    struct sim_device* dev = find_device(bus, dev_id);
+    if (!dev) {
+        errlog_record(ERR_I2C_SIM_DEVICE, 0, dev_id);
+        return -1;
+    }
+
+    return dev - devices;
+}
+
+// Checks a file descriptor like the Linux transport checks its handles
+static int valid(int fd) {
+    if (fd < 0 || (unsigned int)fd >= device_count) {
+        errlog_record(ERR_I2C_HANDLE, 0, fd);
+        return 0;
+    }
+
+    return 1;
+}
+
+static int sim_close(int fd) {
+    return valid(fd) ? 0 : -1;
+}
+
+
+static int sim_read_block(int fd, unsigned char addr, unsigned char* buffer, unsigned int length) {
+    if (!valid(fd))
+        return -1;
+
+    // The address to write the register address, then a repeated start with the address to read
+    transaction(3 + length);
+
+    // The register address auto-increments and wraps around after 0xFF
+    for (unsigned int i = 0; i < length; i++)
+        buffer[i] = devices[fd].regs[(unsigned char)(addr + i)];
+
+    return length;
+}
+
+static int sim_read_segments(int fd, const struct i2c_segment* segments, unsigned int count) {
+    if (!valid(fd))
+        return -1;
+
+    if (count > I2C_MAX_SEGMENTS) {
+        errlog_record(ERR_I2C_SEGMENTS, 0, count);
+        return -1;
+    }
+
+    // All segments share one transaction, separated by repeated starts
+    unsigned int length = 0;
+    for (unsigned int i = 0; i < count; i++)
+        length += 3 + segments[i].length;
+
+    transaction(length);
+
+    for (unsigned int i = 0; i < count; i++)
+        for (unsigned int j = 0; j < segments[i].length; j++)
+            segments[i].buffer[j] = devices[fd].regs[(unsigned char)(segments[i].addr + j)];
+
+    return count;
+}
+
+static int sim_write(int fd, unsigned char addr, unsigned char data) {
+    if (!valid(fd))
+        return -1;
+
+    // The address, the register address, and the value
+    transaction(3);
+    devices[fd].regs[addr] = data;
+
+    return 2;
+}
+
+const struct i2c_transport i2c_sim_transport = {
+    .open          = sim_open,
+    .close         = sim_close,
+    .read_block    = sim_read_block,
+    .read_segments = sim_read_segments,
+    .write         = sim_write,
+};
@@ -0,0 +1,32 @@
+#ifndef INTERFACES_I2C_SIM_H
+#define INTERFACES_I2C_SIM_H
+
+#include "i2c.h"
+
+
+#define I2C_SIM_MAX_DEVICES 8
+
+// An in-process I²C bus modelling devices as 256-byte register maps
+extern const struct i2c_transport i2c_sim_transport;
+
+// Attach a device at dev_id on bus, regs (may be NULL) holds its initial 256 registers
+int i2c_sim_add_device(int bus, int dev_id, const unsigned char* regs);
+
+// Get the register map of the device at dev_id on bus to inspect or modify it
+unsigned char* i2c_sim_registers(int bus, int dev_id);
+
+// Delay every transaction by the given number of microseconds
+void i2c_sim_set_latency(unsigned int latency_us);
+
+// Get the number of transactions since the last i2c_sim_reset
+unsigned long i2c_sim_transactions(void);
+
+// Get the number of bytes on the bus since the last i2c_sim_reset: the address bytes with the
+// read/write bit, the register addresses, and the data
+unsigned long i2c_sim_bytes(void);
+
+// Remove all devices and reset the latency and the counters
+void i2c_sim_reset(void);
+
+
+#endif
@@ -0,0 +1,205 @@
+#include "instrument.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+// The counters of one thread, only written by it. The fields are atomic so instrument_snapshot
+// can read them while the thread runs; as there is a single writer, a relaxed load and store
+// is enough to add to them and compiles to plain instructions
+struct thread_histogram {
+    atomic_ullong count;
+    atomic_ullong errors;
+
+    atomic_ullong sum_ns;
+    atomic_ullong max_ns;
+
+    atomic_ullong buckets[INSTR_BUCKETS];
+};
+
+struct thread_counters {
+    // the reset generation the counters belong to
+    atomic_uint generation;
+    struct thread_histogram ops[INSTR_OP_COUNT];
+
+    struct thread_counters *next;
+};
+
+// The counters of every thread that recorded an operation, never freed so the totals survive the threads
+static _Atomic(struct thread_counters *) threads;
+static atomic_uint generation;
+
+static const char *names[INSTR_OP_COUNT] = {
+    [INSTR_I2C_READ]     = "i2c_read",
+    [INSTR_I2C_WRITE]    = "i2c_write",
+    [INSTR_I2C_IOCTL]    = "i2c_ioctl",
+    [INSTR_SERIAL_READ]  = "serial_read",
+    [INSTR_SERIAL_WRITE] = "serial_write",
+    [INSTR_GPIO_POLL]    = "gpio_poll",
+    [INSTR_DHT22_RETRY]  = "dht22_retry",
+    [INSTR_BME680_RETRY] = "bme680_retry",
+    [INSTR_BME680_READ]  = "bme680_read",
+    [INSTR_DHT22_READ]   = "dht22_read",
+    [INSTR_Z19C_READ]    = "z19c_read",
+};
+
+
+static unsigned long long bucket_value(unsigned int index) {
+    if (index < INSTR_SUB_BUCKETS)
+        return index;
+
+    unsigned int e = index / INSTR_SUB_BUCKETS + 3;
+
+    return (unsigned long long)(INSTR_SUB_BUCKETS + index % INSTR_SUB_BUCKETS) << (e - 4);
+}
+
+#ifdef PERIPHERY_INSTRUMENT
+
+static unsigned int bucket_of(unsigned long long ns) {
+    if (ns < INSTR_SUB_BUCKETS)
+        return ns;
+
+    // the position of the highest bit selects the power of two, the 4 bits below it the sub-bucket
+    unsigned int e = 63 - __builtin_clzll(ns);
+    unsigned int index = (e - 3) * INSTR_SUB_BUCKETS + ((ns >> (e - 4)) & (INSTR_SUB_BUCKETS - 1));
+
+    return index < INSTR_BUCKETS ? index : INSTR_BUCKETS - 1;
+}
+
+static _Thread_local struct thread_counters *local;
+
+static inline void add(atomic_ullong *counter, unsigned long long value) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value,
+        memory_order_relaxed);
+}
+
+unsigned long long instrument_now(void) {
+#if defined(__aarch64__)
+    // the virtual counter is readable from user space and cheaper than even the vDSO clock_gettime,
+    // ticks are converted with a 32.32 fixed-point factor to avoid a division
+    static unsigned long long scale;
+    unsigned long long ticks;
+
+    if (!scale) {
+        unsigned long long freq;
+        __asm__ volatile("mrs %0, cntfrq_el0" : "=r"(freq));
+
+        scale = (1000000000ULL << 32) / freq;
+    }
+
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+
+    return (unsigned long long)(((unsigned __int128)ticks * scale) >> 32);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+void instrument_record(enum instr_op op, unsigned long long duration_ns, int ok) {
+    struct thread_counters *counters = local;
+    unsigned int current = atomic_load_explicit(&generation, memory_order_relaxed);
+
+    if (!counters) {
+        counters = calloc(1, sizeof(*counters));
+        if (!counters)
+            return;
+
+        atomic_store_explicit(&counters->generation, current, memory_order_relaxed);
+
+        // push the thread onto the list instrument_snapshot walks
+        counters->next = atomic_load(&threads);
+        while (!atomic_compare_exchange_weak(&threads, &counters->next, counters))
+            ;
+
+        local = counters;
+    }
+    else if (atomic_load_explicit(&counters->generation, memory_order_relaxed) != current) {
+        // instrument_reset was called since the last operation of this thread
+        for (unsigned int i = 0; i < INSTR_OP_COUNT; i++) {
+            struct thread_histogram *h = &counters->ops[i];
+
+            atomic_store_explicit(&h->count,  0, memory_order_relaxed);
+            atomic_store_explicit(&h->errors, 0, memory_order_relaxed);
+            atomic_store_explicit(&h->sum_ns, 0, memory_order_relaxed);
+            atomic_store_explicit(&h->max_ns, 0, memory_order_relaxed);
+
+            for (unsigned int b = 0; b < INSTR_BUCKETS; b++)
+                atomic_store_explicit(&h->buckets[b], 0, memory_order_relaxed);
+        }
+
+        atomic_store_explicit(&counters->generation, current, memory_order_release);
+    }
+
+    struct thread_histogram *h = &counters->ops[op];
+
+    add(&h->count, 1);
+    add(&h->sum_ns, duration_ns);
+    add(&h->buckets[bucket_of(duration_ns)], 1);
+
+    if (!ok)
+        add(&h->errors, 1);
+
+    if (duration_ns > atomic_load_explicit(&h->max_ns, memory_order_relaxed))
+        atomic_store_explicit(&h->max_ns, duration_ns, memory_order_relaxed);
+}
+
+#endif
+
+void instrument_snapshot(struct instr_snapshot *snapshot) {
+    memset(snapshot, 0, sizeof(*snapshot));
+
+    unsigned int current = atomic_load(&generation);
+
+    for (struct thread_counters *t = atomic_load(&threads); t; t = t->next) {
+        // the counters of threads that did not notice the last reset yet count as zero
+        if (atomic_load_explicit(&t->generation, memory_order_acquire) != current)
+            continue;
+
+        for (unsigned int i = 0; i < INSTR_OP_COUNT; i++) {
+            const struct thread_histogram *h = &t->ops[i];
+            struct instr_histogram *out = &snapshot->ops[i];
+
+            out->count  += atomic_load_explicit(&h->count,  memory_order_relaxed);
+            out->errors += atomic_load_explicit(&h->errors, memory_order_relaxed);
+            out->sum_ns += atomic_load_explicit(&h->sum_ns, memory_order_relaxed);
+
+            unsigned long long max = atomic_load_explicit(&h->max_ns, memory_order_relaxed);
+            if (max > out->max_ns)
+                out->max_ns = max;
+
+            for (unsigned int b = 0; b < INSTR_BUCKETS; b++)
+                out->buckets[b] += atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+        }
+    }
+}
+
+void instrument_reset(void) {
+    atomic_fetch_add(&generation, 1);
+}
+
+unsigned long long instrument_percentile(const struct instr_histogram *histogram, double fraction) {
+    unsigned long long total = 0;
+    for (unsigned int b = 0; b < INSTR_BUCKETS; b++)
+        total += histogram->buckets[b];
+
+    if (!total)
+        return 0;
+
+    unsigned long long rank = fraction * total, seen = 0;
+    for (unsigned int b = 0; b < INSTR_BUCKETS; b++) {
+        seen += histogram->buckets[b];
+        if (seen > rank)
+            return bucket_value(b);
+    }
+
+    return histogram->max_ns;
+}
+
+const char *instrument_name(enum instr_op op) {
+    return (unsigned int)op < INSTR_OP_COUNT ? names[op] : "unknown";
+}
@@ -0,0 +1,78 @@
+#ifndef INTERFACES_INSTRUMENT_H
+#define INTERFACES_INSTRUMENT_H
+
+
+// The instrumented operations
+enum instr_op {
+    INSTR_I2C_READ,
+    INSTR_I2C_WRITE,
+    // selecting the slave address of a shared bus
+    INSTR_I2C_IOCTL,
+    INSTR_SERIAL_READ,
+    INSTR_SERIAL_WRITE,
+    // GPIO_pollForState, from the start to the state or the timeout
+    INSTR_GPIO_POLL,
+    // counted only, a new DHT22 attempt after a failed one
+    INSTR_DHT22_RETRY,
+    // counted only, a BME680 status check after the data should have been ready
+    INSTR_BME680_RETRY,
+    // the synchronous driver reads (bme680_read, dht22_read, z19c_read), from the start to the result
+    INSTR_BME680_READ,
+    INSTR_DHT22_READ,
+    INSTR_Z19C_READ,
+
+    INSTR_OP_COUNT
+};
+
+// Log-linear latency buckets: 16 per power of two (about 6% precision) from 1 ns to 2^40 ns,
+// larger values count in the last bucket
+#define INSTR_SUB_BUCKETS   16
+#define INSTR_BUCKETS       592
+
+struct instr_histogram {
+    unsigned long long count;
+    unsigned long long errors;
+
+    unsigned long long sum_ns;
+    unsigned long long max_ns;
+
+    unsigned long long buckets[INSTR_BUCKETS];
+};
+
+// The totals of all threads since the last instrument_reset
+struct instr_snapshot {
+    struct instr_histogram ops[INSTR_OP_COUNT];
+};
+
+#ifdef PERIPHERY_INSTRUMENT
+
+unsigned long long instrument_now(void);
+// Add an operation of the calling thread, ok is 0 if it failed
+void instrument_record(enum instr_op op, unsigned long long duration_ns, int ok);
+
+// Time the code between INSTR_START and INSTR_END, compiled out without PERIPHERY_INSTRUMENT
+#define INSTR_START(var)            unsigned long long var = instrument_now()
+#define INSTR_END(op, var, ok)      instrument_record(op, instrument_now() - (var), ok)
+#define INSTR_RECORD(op, ns, ok)    instrument_record(op, ns, ok)
+#define INSTR_COUNT(op)             instrument_record(op, 0, 1)
+
+#else
+
+#define INSTR_START(var)            do { } while (0)
+#define INSTR_END(op, var, ok)      do { } while (0)
+#define INSTR_RECORD(op, ns, ok)    do { } while (0)
+#define INSTR_COUNT(op)             do { } while (0)
+
+#endif
+
+// Sum the counters of all threads, all zero without PERIPHERY_INSTRUMENT
+void instrument_snapshot(struct instr_snapshot *snapshot);
+// Start the counters of all threads over, threads clear theirs on their next operation
+void instrument_reset(void);
+
+// Get the latency below which fraction (0-1) of the operations fell, by the lower bound of its bucket
+unsigned long long instrument_percentile(const struct instr_histogram *histogram, double fraction);
+const char *instrument_name(enum instr_op op);
+
+
+#endif
@@ -1,79 +1,115 @@
-#include <stdio.h>
-#include <errno.h>
-#include <fcntl.h> 
-#include <string.h>
-#include <termios.h>
-#include <unistd.h>
-
-
-int serial_open(const char *path, speed_t speed) {
-    int fd = open(path, O_RDWR | O_NOCTTY | O_SYNC);
-    if (fd == -1) {
-        fprintf(stderr, "Error opening serial %s: %s (-%d).\n",
-            path, strerror(errno), errno);
-
-        goto error;
-    }
-
-    struct termios options;
-    if (tcgetattr(fd, &options) != 0) {
-        fprintf(stderr, "Error getting serial parameters for %s: %s (-%d).\n",
-            path, strerror(errno), errno);
-
-        goto close;
-    }
-
-    cfmakeraw(&options);
-    options.c_cc[VMIN]  = 255;
-    options.c_cc[VTIME] = 10;
-
-    if (cfsetispeed(&options, speed) != 0 || cfsetospeed(&options, speed) != 0) {
-        fprintf(stderr, "Error setting serial speed for %s: %s (-%d).\n",
-            path, strerror(errno), errno);
-
-        goto close;
-    }
-
-    if (tcsetattr(fd, TCSANOW, &options) != 0) {
-        fprintf(stderr, "Error setting serial parameters for %s: %s (-%d).\n",
-            path, strerror(errno), errno);
-
-        goto close;
-    }
-
-    return fd;
-
-close:
-    close(fd);
-
-error:
-    return -1;
-}
-
-int serial_close(int fd) {
-    int ret = close(fd);
-    if (ret == -1)
-        fprintf(stderr, "Error closing serial: %s (-%d).\n",
-            strerror(errno), errno);
-
-    return ret;
-}
-
-
-int serial_read(int fd, void *buffer, unsigned int length) {
-    int ret = read(fd, buffer, length);
-    if (ret == -1)
-        fprintf(stderr, "Error reading from serial: %s (-%d).\n",
-            strerror(errno), errno);
-
-    return ret;
-}
-
-int serial_write(int fd, const void *buffer, unsigned int length) {
-    int ret = write(fd, buffer, length);
-    if (ret == -1)
-        fprintf(stderr, "Error writing to serial: %s (-%d).\n",
-            strerror(errno), errno);
-
-    return ret;
-}
+#include "serial.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h> 
+#include <poll.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "errlog.h"
+#include "instrument.h"
+
+
+static int serial_configure(const char *path, speed_t speed, int flags, cc_t vmin, cc_t vtime) {
+    int fd = open(path, O_RDWR | O_NOCTTY | flags);
+    if (fd == -1) {
+        errlog_record_detail(ERR_SERIAL_OPEN, errno, 0, path);
+
+        goto error;
+    }
+
+    struct termios options;
+    if (tcgetattr(fd, &options) != 0) {
+        errlog_record_detail(ERR_SERIAL_GET_PARAMS, errno, 0, path);
+
+        goto close;
+    }
+
+    cfmakeraw(&options);
+    options.c_cc[VMIN]  = vmin;
+    options.c_cc[VTIME] = vtime;
+
+    if (cfsetispeed(&options, speed) != 0 || cfsetospeed(&options, speed) != 0) {
+        errlog_record_detail(ERR_SERIAL_SET_SPEED, errno, 0, path);
+
+        goto close;
+    }
+
+    if (tcsetattr(fd, TCSANOW, &options) != 0) {
+        errlog_record_detail(ERR_SERIAL_SET_PARAMS, errno, 0, path);
+
+        goto close;
+    }
+
+    return fd;
+
+close:
+    close(fd);
+
+error:
+    return -1;
+}
+
+int serial_open(const char *path, speed_t speed) {
+    return serial_configure(path, speed, O_SYNC, 255, 10);
+}
+
+int serial_open_nonblock(const char *path, speed_t speed) {
+    return serial_configure(path, speed, O_NONBLOCK, 0, 0);
+}
+
+int serial_close(int fd) {
+    int ret = close(fd);
+    if (ret == -1)
+        errlog_record(ERR_SERIAL_CLOSE, errno, 0);
+
+    return ret;
+}
+
+
+int serial_read(int fd, void *buffer, unsigned int length) {
+    INSTR_START(start);
+    int ret = read(fd, buffer, length);
+    INSTR_END(INSTR_SERIAL_READ, start, ret != -1 || errno == EAGAIN || errno == EWOULDBLOCK);
+
+    // nothing to read yet on a non-blocking port
+    if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return 0;
+
+    if (ret == -1)
+        errlog_record(ERR_SERIAL_READ, errno, 0);
+
+    return ret;
+}
+
+int serial_write(int fd, const void *buffer, unsigned int length) {
+    INSTR_START(start);
+    int ret = write(fd, buffer, length);
+    INSTR_END(INSTR_SERIAL_WRITE, start, ret != -1);
+    if (ret == -1)
+        errlog_record(ERR_SERIAL_WRITE, errno, 0);
+
+    return ret;
+}
+
+int serial_wait(int fd, int timeout) {
+    struct pollfd p;
+    p.fd = fd;
+    p.events = POLLIN;
+
+    int ret = poll(&p, 1, timeout);
+    if (ret == -1)
+        errlog_record(ERR_SERIAL_WAIT, errno, 0);
+
+    return ret;
+}
+
+int serial_flush(int fd) {
+    int ret = tcflush(fd, TCIFLUSH);
+    if (ret == -1)
+        errlog_record(ERR_SERIAL_FLUSH, errno, 0);
+
+    return ret;
+}
@@ -5,10 +5,17 @@
 
 
 int serial_open(const char *path, speed_t speed);
+// open without blocking reads, serial_read then returns 0 if no data is available
+int serial_open_nonblock(const char *path, speed_t speed);
 int serial_close(int fd);
 
 int serial_read(int fd, void *buffer, unsigned int length);
 int serial_write(int fd, const void *buffer, unsigned int length);
 
+// wait up to timeout ms for data, returns 0 on timeout
+int serial_wait(int fd, int timeout);
+// discard received but unread data
+int serial_flush(int fd);
+
 
 #endif
@@ -1,11 +1,25 @@
 #include "sensors.h"
 
-#include <stdio.h>
 #include <stdint.h>
-#include <unistd.h>
-
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// bme680_compensate has an SSE4.1 kernel on x86-64, compiling with PERIPHERY_SCALAR leaves it out
+#if defined(__x86_64__) && !defined(PERIPHERY_SCALAR)
+#define COMPENSATE_SSE41
+#include <immintrin.h>
+#endif
+
+#include "raw_log.h"
+#include "sample_bus.h"
+#include "../interfaces/errlog.h"
 #include "../interfaces/i2c.h"
+#include "../interfaces/instrument.h"
+
 
+// the calibration registers 0x8A-0xA0, 0xE1-0xEE, and 0x00-0x04
+#define CALIB_SIZE  (23 + 14 + 5)
 
 // coefficients to calculate the real sensor values
 struct coeff_t {
@@ -13,16 +27,65 @@ struct coeff_t {
     int8_t t3, p3, p6, p7, h3, h4, h5, h7;
     uint16_t t1, p1, h1, h2;
     int16_t t2, p2, p4, p5, p8, p9;
-    int32_t t_fine;
+
+    // the gas sensor heater and ADC
+    int8_t gh1, gh3, res_heat_val, range_sw_err;
+    int16_t gh2;
+    uint8_t res_heat_range;
 };
 
-// get the coefficients for the sensor value calculations
-static struct coeff_t get_calib_data(int i2c) {
-    uint8_t coeff_array[23 + 14 + 5];
-    i2c_read_block(i2c, 0x8A, coeff_array, 23);
-    i2c_read_block(i2c, 0xE1, &coeff_array[23], 14);
-    i2c_read_block(i2c, 0x00, &coeff_array[23 + 14], 5);
+// an open BME680 session
+struct bme680 {
+    // the I²C file descriptor, kept open for the whole session
+    int i2c;
 
+    // the coefficients, read and decoded once when the session is opened, and the registers they came from
+    struct coeff_t coeff;
+    uint8_t calib[CALIB_SIZE];
+
+    // the last values written to the config, ctrl_hum, ctrl_meas, and ctrl_gas_1 registers
+    uint8_t config, ctrl_hum, ctrl_meas, ctrl_gas_1;
+
+    // the heater profile set by bme680_set_heater, and the step the next measurement heats to
+    struct bme680_heater_profile heater;
+    unsigned int heater_step;
+
+    // the set-points last written for the profile's steps, and the ambient temperature in °C they
+    // are compensated for, the last measured one
+    uint8_t res_heat[BME680_HEATER_STEPS];
+    int16_t amb_temp;
+
+    // the state of the measurement started by bme680_start
+    int pending;
+    int late;
+    unsigned long long deadline;
+
+    // the result of the last measurement
+    int rc;
+    float temp, pres, hum;
+
+    // the gas resistance of the last measurement, -1 if there was no valid one, and its heater step
+    float gas;
+    unsigned int gas_step;
+
+    // where the results are published, if set
+    struct sample_bus *bus;
+    unsigned int sensor_id;
+
+    // where the raw data is logged, if set
+    struct raw_log *log;
+    unsigned int log_id;
+};
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// decode the coefficients for the sensor value calculations from the calibration registers
+static void parse_calib_data(const uint8_t coeff_array[CALIB_SIZE], struct coeff_t* out) {
     struct coeff_t coeff;
     coeff.t1 = (coeff_array[32] << 8) | coeff_array[31];
     coeff.t2 = (coeff_array[1]  << 8) | coeff_array[0];
@@ -47,11 +110,36 @@ static struct coeff_t get_calib_data(int i2c) {
     coeff.h6 =  coeff_array[29];
     coeff.h7 =  coeff_array[30];
 
-    return coeff;
+    coeff.gh1 = coeff_array[35];
+    coeff.gh2 = (coeff_array[34] << 8) | coeff_array[33];
+    coeff.gh3 = coeff_array[36];
+
+    coeff.res_heat_val   =  coeff_array[37];
+    coeff.res_heat_range = (coeff_array[39] & 0x30) >> 4;
+    coeff.range_sw_err   = (int8_t)(coeff_array[41] & 0xF0) / 16;
+
+    *out = coeff;
+}
+
+// get the coefficients for the sensor value calculations, coeff_array keeps the raw registers
+static int get_calib_data(int i2c, uint8_t coeff_array[CALIB_SIZE], struct coeff_t* out) {
+    const struct i2c_segment segments[] = {
+        { 0x8A,  coeff_array,            23 },
+        { 0xE1, &coeff_array[23],        14 },
+        { 0x00, &coeff_array[23 + 14],    5 },
+    };
+
+    // read all three calibration blocks in one transaction
+    if (i2c_read_segments(i2c, segments, 3) == -1)
+        return -1;
+
+    parse_calib_data(coeff_array, out);
+
+    return 0;
 }
 
 /* This internal API is used to calculate the temperature value. */
-static int16_t calc_temperature(uint32_t temp_adc, struct coeff_t* coeff) {
+static int16_t calc_temperature(uint32_t temp_adc, const struct coeff_t* coeff, int32_t* t_fine) {
     int64_t var1;
     int64_t var2;
     int64_t var3;
@@ -62,15 +150,15 @@ static int16_t calc_temperature(uint32_t temp_adc, struct coeff_t* coeff) {
     var2 = (var1 * (int32_t)coeff->t2) >> 11;
     var3 = ((var1 >> 1) * (var1 >> 1)) >> 12;
     var3 = ((var3) * ((int32_t)coeff->t3 << 4)) >> 14;
-    coeff->t_fine = (int32_t)(var2 + var3);
-    calc_temp = (int16_t)(((coeff->t_fine * 5) + 128) >> 8);
+    *t_fine = (int32_t)(var2 + var3);
+    calc_temp = (int16_t)(((*t_fine * 5) + 128) >> 8);
 
     /*lint -restore */
     return calc_temp;
 }
 
 /* This internal API is used to calculate the pressure value. */
-static uint32_t calc_pressure(uint32_t pres_adc, struct coeff_t coeff) {
+static uint32_t calc_pressure(uint32_t pres_adc, int32_t t_fine, const struct coeff_t* coeff) {
     int32_t var1;
     int32_t var2;
     int32_t var3;
@@ -84,14 +172,14 @@ static uint32_t calc_pressure(uint32_t pres_adc, struct coeff_t coeff) {
     const int32_t pres_ovf_check = INT32_C(0x40000000);
 
     /*lint -save -e701 -e702 -e713 */
-    var1 = (((int32_t)coeff.t_fine) >> 1) - 64000;
-    var2 = ((((var1 >> 2) * (var1 >> 2)) >> 11) * (int32_t)coeff.p6) >> 2;
-    var2 = var2 + ((var1 * (int32_t)coeff.p5) << 1);
-    var2 = (var2 >> 2) + ((int32_t)coeff.p4 << 16);
-    var1 = (((((var1 >> 2) * (var1 >> 2)) >> 13) * ((int32_t)coeff.p3 << 5)) >> 3) +
-           (((int32_t)coeff.p2 * var1) >> 1);
+    var1 = (((int32_t)t_fine) >> 1) - 64000;
+    var2 = ((((var1 >> 2) * (var1 >> 2)) >> 11) * (int32_t)coeff->p6) >> 2;
+    var2 = var2 + ((var1 * (int32_t)coeff->p5) << 1);
+    var2 = (var2 >> 2) + ((int32_t)coeff->p4 << 16);
+    var1 = (((((var1 >> 2) * (var1 >> 2)) >> 13) * ((int32_t)coeff->p3 << 5)) >> 3) +
+           (((int32_t)coeff->p2 * var1) >> 1);
     var1 = var1 >> 18;
-    var1 = ((32768 + var1) * (int32_t)coeff.p1) >> 15;
+    var1 = ((32768 + var1) * (int32_t)coeff->p1) >> 15;
     pressure_comp = 1048576 - pres_adc;
     pressure_comp = (int32_t)((pressure_comp - (var2 >> 12)) * ((uint32_t)3125));
     if (pressure_comp >= pres_ovf_check)
@@ -99,19 +187,19 @@ static uint32_t calc_pressure(uint32_t pres_adc, struct coeff_t coeff) {
     else
         pressure_comp = ((pressure_comp << 1) / var1);
 
-    var1 = ((int32_t)coeff.p9 * (int32_t)(((pressure_comp >> 3) * (pressure_comp >> 3)) >> 13)) >> 12;
-    var2 = ((int32_t)(pressure_comp >> 2) * (int32_t)coeff.p8) >> 13;
+    var1 = ((int32_t)coeff->p9 * (int32_t)(((pressure_comp >> 3) * (pressure_comp >> 3)) >> 13)) >> 12;
+    var2 = ((int32_t)(pressure_comp >> 2) * (int32_t)coeff->p8) >> 13;
     var3 =
         ((int32_t)(pressure_comp >> 8) * (int32_t)(pressure_comp >> 8) * (int32_t)(pressure_comp >> 8) *
-         (int32_t)coeff.p10) >> 17;
-    pressure_comp = (int32_t)(pressure_comp) + ((var1 + var2 + var3 + ((int32_t)coeff.p7 << 7)) >> 4);
+         (int32_t)coeff->p10) >> 17;
+    pressure_comp = (int32_t)(pressure_comp) + ((var1 + var2 + var3 + ((int32_t)coeff->p7 << 7)) >> 4);
 
     /*lint -restore */
     return (uint32_t)pressure_comp;
 }
 
 /* This internal API is used to calculate the humidity in integer */
-static uint32_t calc_humidity(uint16_t hum_adc, struct coeff_t coeff) {
+static uint32_t calc_humidity(uint16_t hum_adc, int32_t t_fine, const struct coeff_t* coeff) {
     int32_t var1;
     int32_t var2;
     int32_t var3;
@@ -122,17 +210,17 @@ static uint32_t calc_humidity(uint16_t hum_adc, struct coeff_t coeff) {
     int32_t calc_hum;
 
     /*lint -save -e702 -e704 */
-    temp_scaled = (((int32_t)coeff.t_fine * 5) + 128) >> 8;
-    var1 = (int32_t)(hum_adc - ((int32_t)((int32_t)coeff.h1 * 16))) -
-           (((temp_scaled * (int32_t)coeff.h3) / ((int32_t)100)) >> 1);
+    temp_scaled = (((int32_t)t_fine * 5) + 128) >> 8;
+    var1 = (int32_t)(hum_adc - ((int32_t)((int32_t)coeff->h1 * 16))) -
+           (((temp_scaled * (int32_t)coeff->h3) / ((int32_t)100)) >> 1);
     var2 =
-        ((int32_t)coeff.h2 *
-         (((temp_scaled * (int32_t)coeff.h4) / ((int32_t)100)) +
-          (((temp_scaled * ((temp_scaled * (int32_t)coeff.h5) / ((int32_t)100))) >> 6) / ((int32_t)100)) +
+        ((int32_t)coeff->h2 *
+         (((temp_scaled * (int32_t)coeff->h4) / ((int32_t)100)) +
+          (((temp_scaled * ((temp_scaled * (int32_t)coeff->h5) / ((int32_t)100))) >> 6) / ((int32_t)100)) +
           (int32_t)(1 << 14))) >> 10;
     var3 = var1 * var2;
-    var4 = (int32_t)coeff.h6 << 7;
-    var4 = ((var4) + ((temp_scaled * (int32_t)coeff.h7) / ((int32_t)100))) >> 4;
+    var4 = (int32_t)coeff->h6 << 7;
+    var4 = ((var4) + ((temp_scaled * (int32_t)coeff->h7) / ((int32_t)100))) >> 4;
     var5 = ((var3 >> 14) * (var3 >> 14)) >> 10;
     var6 = (var4 * var5) >> 1;
     calc_hum = (((var3 + var6) >> 10) * ((int32_t)1000)) >> 12;
@@ -145,66 +233,611 @@ static uint32_t calc_humidity(uint16_t hum_adc, struct coeff_t coeff) {
     return (uint32_t)calc_hum;
 }
 
-// reads the temperature, humidity, and pressure from the BME680 connected through I²C
-int read_bme680_data(float* temp, float* pres, float* hum) {
-    // by default, return that the read operation was unsuccessful
-    int rc = -1;
+/* This internal API is used to calculate the heater resistance value for a target temperature. */
+static uint8_t calc_res_heat(uint16_t temp, int16_t amb_temp, const struct coeff_t* coeff) {
+    int32_t var1;
+    int32_t var2;
+    int32_t var3;
+    int32_t var4;
+    int32_t var5;
+    int32_t heatr_res_x100;
+
+    /* Cap temperature */
+    if (temp > 400)
+        temp = 400;
+
+    var1 = (((int32_t)amb_temp * coeff->gh3) / 1000) * 256;
+    var2 = (coeff->gh1 + 784) * (((((coeff->gh2 + 154009) * temp * 5) / 100) + 3276800) / 10);
+    var3 = var1 + (var2 / 2);
+    var4 = (var3 / (coeff->res_heat_range + 4));
+    var5 = (131 * coeff->res_heat_val) + 65536;
+    heatr_res_x100 = (int32_t)(((var4 / var5) - 250) * 34);
+
+    return (uint8_t)((heatr_res_x100 + 50) / 100);
+}
+
+/* This internal API is used to calculate the heater duration value in 1 ms steps with a 4 bit multiplier. */
+static uint8_t calc_gas_wait(uint16_t dur) {
+    uint8_t factor = 0;
+
+    if (dur >= 0xFC0)
+        return 0xFF; /* Max duration */
+
+    while (dur > 0x3F) {
+        dur = dur / 4;
+        factor += 1;
+    }
+
+    return (uint8_t)(dur + (factor * 64));
+}
+
+/* This internal API is used to calculate the gas resistance value in ohms. */
+static uint32_t calc_gas_resistance(uint16_t gas_res_adc, uint8_t gas_range, const struct coeff_t* coeff) {
+    int64_t var1;
+    uint64_t var2;
+    int64_t var3;
+
+    static const uint32_t lookup_table1[16] = {
+        UINT32_C(2147483647), UINT32_C(2147483647), UINT32_C(2147483647), UINT32_C(2147483647),
+        UINT32_C(2147483647), UINT32_C(2126008810), UINT32_C(2147483647), UINT32_C(2130303777),
+        UINT32_C(2147483647), UINT32_C(2147483647), UINT32_C(2143188679), UINT32_C(2136746228),
+        UINT32_C(2147483647), UINT32_C(2126008810), UINT32_C(2147483647), UINT32_C(2147483647)
+    };
+    static const uint32_t lookup_table2[16] = {
+        UINT32_C(4096000000), UINT32_C(2048000000), UINT32_C(1024000000), UINT32_C(512000000),
+        UINT32_C(255744255),  UINT32_C(127110228),  UINT32_C(64000000),   UINT32_C(32258064),
+        UINT32_C(16016016),   UINT32_C(8000000),    UINT32_C(4000000),    UINT32_C(2000000),
+        UINT32_C(1000000),    UINT32_C(500000),     UINT32_C(250000),     UINT32_C(125000)
+    };
+
+    /*lint -save -e704 */
+    var1 = (int64_t)((1340 + (5 * (int64_t)coeff->range_sw_err)) * ((int64_t)lookup_table1[gas_range])) >> 16;
+    var2 = (((int64_t)((int64_t)gas_res_adc << 15) - (int64_t)(16777216)) + var1);
+    var3 = (((int64_t)lookup_table2[gas_range] * (int64_t)var1) >> 9);
 
-    // connect to the I²C interface at the address 0x77
-    int i2c = i2c_open(0x77);
+    /*lint -restore */
+    return (uint32_t)((var3 + ((int64_t)var2 >> 1)) / (int64_t)var2);
+}
+
+const struct bme680_config bme680_low_latency = {
+    BME680_OS_1X, BME680_OS_1X, BME680_OS_1X, BME680_FILTER_OFF
+};
+
+const struct bme680_config bme680_balanced = {
+    BME680_OS_8X, BME680_OS_4X, BME680_OS_2X, BME680_FILTER_3
+};
+
+const struct bme680_config bme680_low_noise = {
+    BME680_OS_16X, BME680_OS_16X, BME680_OS_16X, BME680_FILTER_15
+};
+
+// sets the oversampling and the IIR filter of a session, writes the registers the measurements don't
+int bme680_configure(struct bme680* dev, const struct bme680_config* config) {
+    if ((unsigned int)config->temp_os > BME680_OS_16X || (unsigned int)config->pres_os > BME680_OS_16X ||
+        (unsigned int)config->hum_os  > BME680_OS_16X || (unsigned int)config->filter > BME680_FILTER_127) {
+        errlog_record(ERR_BME680_CONFIG, 0, 0);
+        return -1;
+    }
+
+    // filter (config bits 4-2), humidity oversampling (ctrl_hum bits 2-0)
+    dev->config   = config->filter << 2;
+    dev->ctrl_hum = config->hum_os;
+
+    // temperature oversampling (bits 7-5), pressure oversampling (bits 4-2), and "Forced Mode" (bits 1-0),
+    // written with every measurement to trigger it
+    dev->ctrl_meas = config->temp_os << 5 | config->pres_os << 2 | 0b01;
+
+    if (i2c_write(dev->i2c, 0x75, dev->config)   == -1 ||
+        i2c_write(dev->i2c, 0x72, dev->ctrl_hum) == -1)
+        return -1;
+
+    return 0;
+}
+
+// opens a session to the BME680 at addr on an I²C bus, configures it, and reads its calibration data
+struct bme680* bme680_open(int bus, int addr) {
+    struct bme680* dev = malloc(sizeof(*dev));
+    if (!dev)
+        return NULL;
+
+    // connect to the I²C interface, the bus is shared with the other open devices on it
+    dev->i2c = i2c_open_bus(bus, addr);
+    if (dev->i2c == -1)
+        goto free;
+
+    // the gas sensor is off until a heater profile is set
+    dev->ctrl_gas_1 = 0;
+    dev->heater.count = 0;
+    dev->heater_step  = 0;
+    dev->amb_temp     = 25;
+    dev->gas = -1;
+
+    dev->pending = 0;
+    dev->rc = -1;
+    dev->bus = NULL;
+    dev->log = NULL;
+
+    if (bme680_configure(dev, &bme680_balanced) == -1)
+        goto close;
+
+    // get the coefficients for the sensor value calculations
+    if (get_calib_data(dev->i2c, dev->calib, &dev->coeff) == -1)
+        goto close;
+
+    return dev;
+
+close:
+    i2c_close(dev->i2c);
 
-    // set the filter coefficient to 3
-    i2c_write(i2c, 0x75, 0b00001000);
+free:
+    free(dev);
 
-    // set the humidity oversampling to x2
-    i2c_write(i2c, 0x72, 0b00000010);
+    return NULL;
+}
+
+// closes a session opened by bme680_open
+int bme680_close(struct bme680* dev) {
+    // replay sessions have no I²C connection
+    int ret = dev->i2c == -1 ? 0 : i2c_close(dev->i2c);
+    free(dev);
+
+    return ret;
+}
+
+// programs the heater set-points of a profile and turns the gas sensor on, or off if profile is NULL or empty
+int bme680_set_heater(struct bme680* dev, const struct bme680_heater_profile* profile) {
+    if (!profile || profile->count == 0) {
+        dev->heater.count = 0;
+        dev->ctrl_gas_1   = 0;
+
+        return i2c_write(dev->i2c, 0x71, dev->ctrl_gas_1) == -1 ? -1 : 0;
+    }
+
+    if (profile->count > BME680_HEATER_STEPS) {
+        errlog_record(ERR_BME680_STEPS, 0, profile->count);
+        return -1;
+    }
+
+    // all steps are kept in the sensor's set-points 0-9 (res_heat_x at 0x5A, gas_wait_x at 0x64),
+    // so switching between them only takes a write of nb_conv
+    for (unsigned int i = 0; i < profile->count; i++) {
+        dev->res_heat[i] = calc_res_heat(profile->temp[i], dev->amb_temp, &dev->coeff);
+
+        if (i2c_write(dev->i2c, 0x5A + i, dev->res_heat[i]) == -1 ||
+            i2c_write(dev->i2c, 0x64 + i, calc_gas_wait(profile->duration[i])) == -1)
+            return -1;
+    }
 
-    // set the temperature oversampling to x8
-    // set the pressure oversampling to x4
-    // set the sensor power mode to "Forced Mode"
-    i2c_write(i2c, 0x74, 0b10001101);
+    dev->heater = *profile;
+    dev->heater_step = 0;
 
-    // try max. 10 times to read the sensor values
-    for (int i = 0; i < 10; i++) {
-        // check if new data is available (bit 7 is set)
-        if (i2c_read(i2c, 0x1D) != 0b10000000) {
-            // sleep/wait 10ms
-            usleep(10000);
+    // set run_gas and select the first step
+    dev->ctrl_gas_1 = 0b00010000;
 
-            // continue with the next iteration
-            continue;
+    return i2c_write(dev->i2c, 0x71, dev->ctrl_gas_1) == -1 ? -1 : 0;
+}
+
+// the time from triggering a forced-mode measurement to its data being ready, without the heater, in µs
+static unsigned int meas_duration_us(const struct bme680* dev) {
+    // the conversions of each oversampling setting (skipped, x1, x2, x4, x8, x16)
+    static const uint8_t os_to_meas_cycles[8] = { 0, 1, 2, 4, 8, 16, 16, 16 };
+
+    unsigned int meas_cycles = os_to_meas_cycles[dev->ctrl_meas >> 5] +
+                               os_to_meas_cycles[(dev->ctrl_meas >> 2) & 0x07] +
+                               os_to_meas_cycles[dev->ctrl_hum & 0x07];
+
+    unsigned int meas_dur = meas_cycles * 1963;
+    meas_dur += 477 * 4;    // TPH switching duration
+    meas_dur += 477 * 5;    // gas measurement duration
+    meas_dur += 1000;       // wake up duration
+
+    return meas_dur;
+}
+
+// triggers a measurement, bme680_step then collects it without blocking
+int bme680_start(struct bme680* dev) {
+    dev->pending = 0;
+    dev->rc = -1;
+
+    unsigned long long heat_ns = 0;
+    if (dev->heater.count) {
+        const unsigned int step = dev->heater_step;
+
+        // the heater resistance depends on the ambient temperature, follow the last measured one
+        uint8_t res_heat = calc_res_heat(dev->heater.temp[step], dev->amb_temp, &dev->coeff);
+        if (res_heat != dev->res_heat[step]) {
+            if (i2c_write(dev->i2c, 0x5A + step, res_heat) == -1)
+                return -1;
+
+            dev->res_heat[step] = res_heat;
         }
 
-        // read the sensor values into a buffer
-        uint8_t buff[8];
-        i2c_read_block(i2c, 0x1F, buff, 8);
+        // select the heater step of this measurement (nb_conv) if it changed
+        uint8_t ctrl_gas_1 = 0b00010000 | step;
+        if (ctrl_gas_1 != dev->ctrl_gas_1) {
+            if (i2c_write(dev->i2c, 0x71, ctrl_gas_1) == -1)
+                return -1;
 
-        // save the raw pressure, temperature, and humidity
-        uint32_t pres_adc = (buff[0] << 12) | (buff[1] << 4) | (buff[2] >> 4);
-        uint32_t temp_adc = (buff[3] << 12) | (buff[4] << 4) | (buff[5] >> 4);
-        uint16_t hum_adc  = (buff[6] <<  8) |  buff[7];
+            dev->ctrl_gas_1 = ctrl_gas_1;
+        }
 
-        // get the coefficients for the sensor value calculations
-        struct coeff_t coeff = get_calib_data(i2c);
+        heat_ns = dev->heater.duration[step] * 1000000ULL;
+    }
+
+    // trigger a measurement, the sensor goes back to sleep after each one in "Forced Mode"
+    if (i2c_write(dev->i2c, 0x74, dev->ctrl_meas) == -1)
+        return -1;
+
+    // check for the data once, when the conversions and the heater should be done
+    dev->pending  = 1;
+    dev->late     = 0;
+    dev->deadline = now_ns() + meas_duration_us(dev) * 1000ULL + heat_ns;
+
+    return SENSOR_PENDING;
+}
+
+// calculates the values from a burst read of 0x1D, which includes the gas ADC if gas is set
+static void decode_burst(struct bme680* dev, const uint8_t* buff, int gas) {
+    // save the raw pressure, temperature, and humidity
+    uint32_t pres_adc = (buff[2] << 12) | (buff[3] << 4) | (buff[4] >> 4);
+    uint32_t temp_adc = (buff[5] << 12) | (buff[6] << 4) | (buff[7] >> 4);
+    uint16_t hum_adc  = (buff[8] <<  8) |  buff[9];
+
+    // calculate the real temperature, humidity, and pressure as integers
+    int32_t t_fine;
+    int16_t calc_temp  = calc_temperature(temp_adc, &dev->coeff, &t_fine);
+    uint32_t calc_pres = calc_pressure(pres_adc, t_fine, &dev->coeff);
+    uint32_t calc_hum  = calc_humidity(hum_adc, t_fine, &dev->coeff);
+
+    // convert the values to float and save them
+    dev->temp = calc_temp / 100.0F;
+    dev->pres = calc_pres / 100.0F;
+    dev->hum  = calc_hum  / 1000.0F;
+    dev->amb_temp = calc_temp / 100;
+
+    // the gas resistance only counts if it is valid (bit 5) and the heater was stable (bit 4)
+    dev->gas = -1;
+    if (gas && (buff[14] & 0b00110000) == 0b00110000) {
+        uint16_t gas_adc = (buff[13] << 2) | (buff[14] >> 6);
+        dev->gas = calc_gas_resistance(gas_adc, buff[14] & 0x0F, &dev->coeff);
+    }
+}
+
+// advances the measurement once its deadline passed, returns SENSOR_PENDING, 0, or -1
+int bme680_step(struct bme680* dev) {
+    if (!dev->pending)
+        return dev->rc;
+
+    if (now_ns() < dev->deadline)
+        return SENSOR_PENDING;
+
+    // read the status (0x1D), the sensor values (0x1F-0x26), and with the heater on the gas ADC (0x2A-0x2B) in one burst,
+    // followed by the heater step for the log
+    uint8_t buff[16];
+    if (i2c_read_block(dev->i2c, 0x1D, buff, dev->heater.count ? 15 : 10) == -1) {
+        dev->pending = 0;
+        return dev->rc;
+    }
+
+    // check if new data is available (bit 7) and the measuring (bit 5) and gas_measuring (bit 6) are done,
+    // the low bits hold the heater step
+    if ((buff[0] & 0b11100000) != 0b10000000) {
+        // allow for the sensor's clock running a bit slow, up to 3 more checks 1 ms apart
+        if (++dev->late > 3) {
+            errlog_record(ERR_BME680_NOT_READY, 0, 0);
+            dev->pending = 0;
+
+            return dev->rc;
+        }
+
+        INSTR_COUNT(INSTR_BME680_RETRY);
+        dev->deadline += 1000000;
+
+        return SENSOR_PENDING;
+    }
+
+    if (dev->log) {
+        buff[15] = dev->heater_step;
+        raw_log_append(dev->log, RAW_LOG_BME680, dev->log_id, now_ns(), buff, dev->heater.count ? 16 : 10);
+    }
+
+    decode_burst(dev, buff, dev->heater.count != 0);
 
-        // calculate the real temperature, humidity, and pressure as integers
-        int16_t calc_temp  = calc_temperature(temp_adc, &coeff);
-        uint32_t calc_pres = calc_pressure(pres_adc, coeff);
-        uint32_t calc_hum  = calc_humidity(hum_adc, coeff);
+    if (dev->heater.count) {
+        // the next measurement heats to the next step of the profile
+        dev->gas_step    = dev->heater_step;
+        dev->heater_step = (dev->heater_step + 1) % dev->heater.count;
+    }
+
+    dev->pending = 0;
+    dev->rc = 0;
+
+    if (dev->bus) {
+        const struct sample sample = {
+            dev->sensor_id, dev->heater.count ? 4 : 3, now_ns(),
+            { dev->temp, dev->pres, dev->hum, dev->gas }
+        };
+        sample_bus_publish(dev->bus, &sample);
+    }
+
+    return 0;
+}
 
-        // convert the values to float and "return" them
-        *temp = calc_temp / 100.0F;
-        *pres = calc_pres / 100.0F;
-        *hum  = calc_hum  / 1000.0F;
+void bme680_set_bus(struct bme680* dev, struct sample_bus* bus, unsigned int sensor_id) {
+    dev->bus = bus;
+    dev->sensor_id = sensor_id;
+}
+
+// logs the raw data of every measurement to log as sensor_id, starting with the calibration; NULL stops it
+int bme680_set_log(struct bme680* dev, struct raw_log* log, unsigned int sensor_id) {
+    dev->log = log;
+    dev->log_id = sensor_id;
+
+    if (!log)
+        return 0;
 
-        // return that the read operation was successful
-        rc = 0;
+    return raw_log_append(log, RAW_LOG_BME680_CALIB, sensor_id, now_ns(), dev->calib, CALIB_SIZE);
+}
 
-        break;
+// creates a session without a sensor from logged calibration registers, for bme680_decode_raw
+struct bme680* bme680_open_replay(const void* calib, unsigned int length) {
+    if (length != CALIB_SIZE) {
+        errlog_record(ERR_BME680_CALIB, 0, length);
+        return NULL;
     }
 
+    struct bme680* dev = calloc(1, sizeof(*dev));
+    if (!dev)
+        return NULL;
+
+    dev->i2c = -1;
+    dev->rc  = -1;
+    dev->gas = -1;
+
+    memcpy(dev->calib, calib, CALIB_SIZE);
+    parse_calib_data(dev->calib, &dev->coeff);
+
+    return dev;
+}
+
+// calculates the values of a logged burst read like bme680_step does, get them with bme680_result
+int bme680_decode_raw(struct bme680* dev, const void* raw, unsigned int length) {
+    if (length != 10 && length != 16) {
+        errlog_record(ERR_BME680_RAW_LENGTH, 0, length);
+        return -1;
+    }
+
+    decode_burst(dev, raw, length == 16);
+    if (length == 16)
+        dev->gas_step = ((const uint8_t*)raw)[15];
+
+    dev->pending = 0;
+    dev->rc = 0;
+
+    return 0;
+}
+
+unsigned long long bme680_deadline(const struct bme680* dev) {
+    return dev->deadline;
+}
+
+// gets the values of the last measurement
+int bme680_result(const struct bme680* dev, float* temp, float* pres, float* hum) {
+    if (dev->pending || dev->rc != 0)
+        return -1;
+
+    *temp = dev->temp;
+    *pres = dev->pres;
+    *hum  = dev->hum;
+
+    return 0;
+}
+
+#if defined(COMPENSATE_SSE41)
+
+/* The batch kernel below does the integer math of calc_temperature, calc_pressure, and calc_humidity for
+ * four samples at once and gives bit for bit the same results for the 20-bit ADC values of the sensor:
+ * - the 64-bit products of the temperature are 32x32->64 multiplies, the shifted results fit in 32 bits
+ * - the int32 arithmetic of the pressure and humidity wraps in the lanes like it does in the scalar code
+ * - the division of the pressure is exact in double, an int32 quotient rounded to 53 bits can't cross
+ *   an integer, and the truncating conversion back rounds toward zero like the C division
+ * - the divisions by 100 of the humidity are the multiply-high by 0x51EB851F that compilers use for them
+ */
+#define DIV100_MAGIC  0x51EB851F
+
+// SSE4.1 isn't in the x86-64 baseline, so these are compiled for it and only used when the CPU has it
+#define SSE41  __attribute__((target("sse4.1")))
+
+// the low 32 bits of the 64-bit products a * b >> shift, shift is at most 32
+SSE41 static inline __m128i mul_shift64_sse41(__m128i a, __m128i b, int shift) {
+    const __m128i right = _mm_cvtsi32_si128(shift);
+    __m128i even = _mm_srl_epi64(_mm_mul_epi32(a, b), right);
+    __m128i odd  = _mm_srl_epi64(_mm_mul_epi32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32)), right);
+
+    return _mm_blend_epi16(even, _mm_slli_epi64(odd, 32), 0xCC);
+}
+
+// x / 100 truncated toward zero
+SSE41 static inline __m128i div100_sse41(__m128i x) {
+    __m128i q = _mm_srai_epi32(mul_shift64_sse41(x, _mm_set1_epi32(DIV100_MAGIC), 32), 5);
+
+    return _mm_sub_epi32(q, _mm_srai_epi32(x, 31));
+}
+
+// a / b truncated toward zero
+SSE41 static inline __m128i div_sse41(__m128i a, __m128i b) {
+    __m128d lo = _mm_div_pd(_mm_cvtepi32_pd(a), _mm_cvtepi32_pd(b));
+    __m128d hi = _mm_div_pd(_mm_cvtepi32_pd(_mm_unpackhi_epi64(a, a)), _mm_cvtepi32_pd(_mm_unpackhi_epi64(b, b)));
+
+    return _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+}
+
+// converts unsigned values to float with a single rounding, both halves and their sum before it are exact
+SSE41 static inline __m128 u32_to_float_sse41(__m128i u) {
+    __m128 hi = _mm_cvtepi32_ps(_mm_srli_epi32(u, 16));
+    __m128 lo = _mm_cvtepi32_ps(_mm_and_si128(u, _mm_set1_epi32(0xFFFF)));
+
+    return _mm_add_ps(_mm_mul_ps(hi, _mm_set1_ps(65536.0F)), lo);
+}
+
+// compensates the samples in groups of four, returns how many it did
+SSE41 static unsigned int compensate_sse41(const struct coeff_t* c, unsigned int count,
+    const unsigned int* restrict temp_adc, const unsigned int* restrict pres_adc, const unsigned short* restrict hum_adc,
+    float* restrict temp, float* restrict pres, float* restrict hum) {
+    unsigned int i;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        // calc_temperature
+        __m128i var1 = _mm_sub_epi32(_mm_srai_epi32(_mm_loadu_si128((const __m128i*)&temp_adc[i]), 3),
+                                     _mm_set1_epi32((int32_t)c->t1 << 1));
+        __m128i var2 = mul_shift64_sse41(var1, _mm_set1_epi32(c->t2), 11);
+        __m128i var3 = _mm_srai_epi32(var1, 1);
+        var3 = mul_shift64_sse41(var3, var3, 12);
+        var3 = mul_shift64_sse41(var3, _mm_set1_epi32((int32_t)c->t3 << 4), 14);
+        __m128i t_fine = _mm_add_epi32(var2, var3);
+
+        // the temperature scaled by 100, calc_temperature truncates it to 16 bits
+        __m128i scaled = _mm_mullo_epi32(t_fine, _mm_set1_epi32(5));
+        scaled = _mm_srai_epi32(_mm_add_epi32(scaled, _mm_set1_epi32(128)), 8);
+        __m128i calc_temp = _mm_srai_epi32(_mm_slli_epi32(scaled, 16), 16);
+        _mm_storeu_ps(&temp[i], _mm_div_ps(_mm_cvtepi32_ps(calc_temp), _mm_set1_ps(100.0F)));
+
+        if (pres) {
+            // calc_pressure
+            var1 = _mm_sub_epi32(_mm_srai_epi32(t_fine, 1), _mm_set1_epi32(64000));
+            __m128i square = _mm_srai_epi32(var1, 2);
+            square = _mm_mullo_epi32(square, square);
+            var2 = _mm_srai_epi32(_mm_mullo_epi32(_mm_srai_epi32(square, 11), _mm_set1_epi32(c->p6)), 2);
+            var2 = _mm_add_epi32(var2, _mm_slli_epi32(_mm_mullo_epi32(var1, _mm_set1_epi32(c->p5)), 1));
+            var2 = _mm_add_epi32(_mm_srai_epi32(var2, 2), _mm_set1_epi32((int32_t)c->p4 << 16));
+            var1 = _mm_add_epi32(
+                _mm_srai_epi32(_mm_mullo_epi32(_mm_srai_epi32(square, 13), _mm_set1_epi32((int32_t)c->p3 << 5)), 3),
+                _mm_srai_epi32(_mm_mullo_epi32(var1, _mm_set1_epi32(c->p2)), 1));
+            var1 = _mm_srai_epi32(var1, 18);
+            var1 = _mm_add_epi32(var1, _mm_set1_epi32(32768));
+            var1 = _mm_srai_epi32(_mm_mullo_epi32(var1, _mm_set1_epi32(c->p1)), 15);
+
+            __m128i comp = _mm_sub_epi32(_mm_set1_epi32(1048576), _mm_loadu_si128((const __m128i*)&pres_adc[i]));
+            comp = _mm_mullo_epi32(_mm_sub_epi32(comp, _mm_srai_epi32(var2, 12)), _mm_set1_epi32(3125));
+
+            // divide first for the large values, shift first for the others
+            __m128i large = _mm_cmpgt_epi32(comp, _mm_set1_epi32(0x40000000 - 1));
+            __m128i quot = div_sse41(_mm_blendv_epi8(_mm_slli_epi32(comp, 1), comp, large), var1);
+            comp = _mm_blendv_epi8(quot, _mm_slli_epi32(quot, 1), large);
+
+            __m128i part = _mm_srai_epi32(comp, 3);
+            var1 = _mm_srai_epi32(_mm_mullo_epi32(part, part), 13);
+            var1 = _mm_srai_epi32(_mm_mullo_epi32(var1, _mm_set1_epi32(c->p9)), 12);
+            var2 = _mm_srai_epi32(_mm_mullo_epi32(_mm_srai_epi32(comp, 2), _mm_set1_epi32(c->p8)), 13);
+            part = _mm_srai_epi32(comp, 8);
+            var3 = _mm_mullo_epi32(_mm_mullo_epi32(part, part), part);
+            var3 = _mm_srai_epi32(_mm_mullo_epi32(var3, _mm_set1_epi32(c->p10)), 17);
+            var1 = _mm_add_epi32(_mm_add_epi32(var1, var2), _mm_add_epi32(var3, _mm_set1_epi32((int32_t)c->p7 << 7)));
+            comp = _mm_add_epi32(comp, _mm_srai_epi32(var1, 4));
+
+            _mm_storeu_ps(&pres[i], _mm_div_ps(u32_to_float_sse41(comp), _mm_set1_ps(100.0F)));
+        }
+
+        if (hum) {
+            // calc_humidity
+            __m128i adc = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)&hum_adc[i]));
+            var1 = _mm_sub_epi32(_mm_sub_epi32(adc, _mm_set1_epi32((int32_t)c->h1 * 16)),
+                                 _mm_srai_epi32(div100_sse41(_mm_mullo_epi32(scaled, _mm_set1_epi32(c->h3))), 1));
+            __m128i h5 = div100_sse41(_mm_mullo_epi32(scaled, _mm_set1_epi32(c->h5)));
+            var2 = _mm_add_epi32(div100_sse41(_mm_mullo_epi32(scaled, _mm_set1_epi32(c->h4))),
+                                 div100_sse41(_mm_srai_epi32(_mm_mullo_epi32(scaled, h5), 6)));
+            var2 = _mm_add_epi32(var2, _mm_set1_epi32(1 << 14));
+            var2 = _mm_srai_epi32(_mm_mullo_epi32(var2, _mm_set1_epi32(c->h2)), 10);
+            var3 = _mm_mullo_epi32(var1, var2);
+            __m128i var4 = _mm_add_epi32(_mm_set1_epi32((int32_t)c->h6 << 7),
+                                         div100_sse41(_mm_mullo_epi32(scaled, _mm_set1_epi32(c->h7))));
+            var4 = _mm_srai_epi32(var4, 4);
+            __m128i var5 = _mm_srai_epi32(var3, 14);
+            var5 = _mm_srai_epi32(_mm_mullo_epi32(var5, var5), 10);
+            __m128i var6 = _mm_srai_epi32(_mm_mullo_epi32(var4, var5), 1);
+            __m128i calc_hum = _mm_srai_epi32(_mm_add_epi32(var3, var6), 10);
+            calc_hum = _mm_srai_epi32(_mm_mullo_epi32(calc_hum, _mm_set1_epi32(1000)), 12);
+            calc_hum = _mm_min_epi32(_mm_max_epi32(calc_hum, _mm_setzero_si128()), _mm_set1_epi32(100000));
+
+            _mm_storeu_ps(&hum[i], _mm_div_ps(_mm_cvtepi32_ps(calc_hum), _mm_set1_ps(1000.0F)));
+        }
+    }
+
+    return i;
+}
+
+#endif
+
+// compensates a batch of raw samples with the session's calibration, the coefficients are copied
+// once so they stay in registers instead of being reloaded through dev for every sample
+void bme680_compensate(const struct bme680* dev, unsigned int count,
+    const unsigned int* restrict temp_adc, const unsigned int* restrict pres_adc, const unsigned short* restrict hum_adc,
+    float* restrict temp, float* restrict pres, float* restrict hum) {
+    const struct coeff_t coeff = dev->coeff;
+    unsigned int i = 0;
+
+#if defined(COMPENSATE_SSE41)
+    if (__builtin_cpu_supports("sse4.1"))
+        i = compensate_sse41(&coeff, count, temp_adc, pres_adc, hum_adc, temp, pres, hum);
+#endif
+
+    // the rest that doesn't fill a group of four
+    for (; i < count; i++) {
+        // pressure and humidity both need the fine temperature
+        int32_t t_fine;
+        temp[i] = calc_temperature(temp_adc[i], &coeff, &t_fine) / 100.0F;
+
+        if (pres)
+            pres[i] = calc_pressure(pres_adc[i], t_fine, &coeff) / 100.0F;
+        if (hum)
+            hum[i] = calc_humidity(hum_adc[i], t_fine, &coeff) / 1000.0F;
+    }
+}
+
+// gets the gas resistance (Ω) of the last measurement and the heater step it was taken at
+int bme680_gas_result(const struct bme680* dev, float* gas, unsigned int* step) {
+    if (dev->pending || dev->rc != 0 || dev->gas < 0)
+        return -1;
+
+    *gas = dev->gas;
+    if (step)
+        *step = dev->gas_step;
+
+    return 0;
+}
+
+// reads the temperature, humidity, and pressure from an open BME680 session
+int bme680_read(struct bme680* dev, float* temp, float* pres, float* hum) {
+    INSTR_START(start);
+
+    int rc = bme680_start(dev);
+    while (rc == SENSOR_PENDING) {
+        // sleep until the next check
+        long long wait_ns = bme680_deadline(dev) - now_ns();
+        if (wait_ns > 0) {
+            struct timespec ts = { wait_ns / 1000000000, wait_ns % 1000000000 };
+            nanosleep(&ts, NULL);
+        }
+
+        rc = bme680_step(dev);
+    }
+
+    rc = rc == 0 ? bme680_result(dev, temp, pres, hum) : -1;
+    INSTR_END(INSTR_BME680_READ, start, rc == 0);
+
+    return rc;
+}
+
+// reads the temperature, humidity, and pressure from the BME680 connected through I²C
+int read_bme680_data(float* temp, float* pres, float* hum) {
+    struct bme680* dev = bme680_open(I2C_DEFAULT_BUS, BME680_ADDR_HIGH);
+    if (!dev)
+        return -1;
+
+    int rc = bme680_read(dev, temp, pres, hum);
+
     // close the I²C Interface
-    i2c_close(i2c);
+    bme680_close(dev);
 
     return rc;
 }
@@ -0,0 +1,108 @@
+#include "bme680_sim.h"
+
+#include <stddef.h>
+
+#include "../interfaces/i2c_sim.h"
+
+
+// the raw values of the default measurement, about 25 °C, 1000 hPa, and 40 %
+#define DEFAULT_TEMP_ADC    500000
+#define DEFAULT_PRES_ADC    330000
+#define DEFAULT_HUM_ADC     21000
+
+const struct bme680_sim_calib bme680_sim_default_calib = {
+    .t1 = 26133, .t2 = 26229, .t3 = 3,
+
+    .p1 = 36441, .p2 = -10409, .p3 = 88, .p4 = 7066, .p5 = -49,
+    .p6 = 30, .p7 = 32, .p8 = -3498, .p9 = -3126, .p10 = 30,
+
+    .h1 = 765, .h2 = 1009, .h3 = 0, .h4 = 45, .h5 = 20, .h6 = 120, .h7 = -100,
+
+    .gh1 = -30, .gh2 = -5969, .gh3 = 18,
+    .res_heat_range = 1, .res_heat_val = 43, .range_sw_err = 0,
+};
+
+
+static void set16(unsigned char *regs, unsigned char lsb, unsigned char msb, unsigned short value) {
+    regs[lsb] = value & 0xFF;
+    regs[msb] = value >> 8;
+}
+
+int bme680_sim_add(int bus, int addr, const struct bme680_sim_calib *calib) {
+    if (!calib)
+        calib = &bme680_sim_default_calib;
+
+    if (i2c_sim_add_device(bus, addr, NULL) == -1)
+        return -1;
+
+    unsigned char *regs = i2c_sim_registers(bus, addr);
+
+    // the registers the driver reads the coefficients from (0x8A-0xA0, 0xE1-0xEE, 0x00-0x04)
+    set16(regs, 0xE9, 0xEA, calib->t1);
+    set16(regs, 0x8A, 0x8B, calib->t2);
+    regs[0x8C] = calib->t3;
+
+    set16(regs, 0x8E, 0x8F, calib->p1);
+    set16(regs, 0x90, 0x91, calib->p2);
+    regs[0x92] = calib->p3;
+    set16(regs, 0x94, 0x95, calib->p4);
+    set16(regs, 0x96, 0x97, calib->p5);
+    regs[0x98] = calib->p7;
+    regs[0x99] = calib->p6;
+    set16(regs, 0x9C, 0x9D, calib->p8);
+    set16(regs, 0x9E, 0x9F, calib->p9);
+    regs[0xA0] = calib->p10;
+
+    // h1 and h2 are 12 bits, sharing the nibbles of 0xE2
+    regs[0xE1] = calib->h2 >> 4;
+    regs[0xE2] = (calib->h2 & 0x0F) << 4 | (calib->h1 & 0x0F);
+    regs[0xE3] = calib->h1 >> 4;
+    regs[0xE4] = calib->h3;
+    regs[0xE5] = calib->h4;
+    regs[0xE6] = calib->h5;
+    regs[0xE7] = calib->h6;
+    regs[0xE8] = calib->h7;
+
+    set16(regs, 0xEB, 0xEC, calib->gh2);
+    regs[0xED] = calib->gh1;
+    regs[0xEE] = calib->gh3;
+
+    regs[0x00] = calib->res_heat_val;
+    regs[0x02] = (calib->res_heat_range & 0x03) << 4;
+    regs[0x04] = (calib->range_sw_err & 0x0F) << 4;
+
+    bme680_sim_set_adc(bus, addr, DEFAULT_TEMP_ADC, DEFAULT_PRES_ADC, DEFAULT_HUM_ADC);
+
+    return 0;
+}
+
+void bme680_sim_set_adc(int bus, int addr, unsigned int temp_adc, unsigned int pres_adc, unsigned short hum_adc) {
+    unsigned char *regs = i2c_sim_registers(bus, addr);
+    if (!regs)
+        return;
+
+    // new data (bit 7), not measuring
+    regs[0x1D] = 0x80;
+
+    // 20 bit values, MSB first with the low nibble in the upper half of the xlsb register
+    regs[0x1F] = pres_adc >> 12;
+    regs[0x20] = pres_adc >> 4;
+    regs[0x21] = (pres_adc & 0x0F) << 4;
+
+    regs[0x22] = temp_adc >> 12;
+    regs[0x23] = temp_adc >> 4;
+    regs[0x24] = (temp_adc & 0x0F) << 4;
+
+    regs[0x25] = hum_adc >> 8;
+    regs[0x26] = hum_adc & 0xFF;
+}
+
+void bme680_sim_set_gas(int bus, int addr, unsigned short gas_adc, unsigned int range) {
+    unsigned char *regs = i2c_sim_registers(bus, addr);
+    if (!regs)
+        return;
+
+    // 10 bit value, then gas_valid (bit 5), heat_stab (bit 4), and the range
+    regs[0x2A] = gas_adc >> 2;
+    regs[0x2B] = (gas_adc & 0x03) << 6 | 0x30 | (range & 0x0F);
+}
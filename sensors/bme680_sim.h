@@ -0,0 +1,42 @@
+#ifndef SENSORS_BME680_SIM_H
+#define SENSORS_BME680_SIM_H
+
+
+// The calibration parameters of an emulated BME680, named like the datasheet's par_*
+struct bme680_sim_calib {
+    unsigned short t1;
+    short t2;
+    signed char t3;
+
+    unsigned short p1;
+    short p2, p4, p5, p8, p9;
+    signed char p3, p6, p7;
+    unsigned char p10;
+
+    unsigned short h1, h2;
+    signed char h3, h4, h5, h7;
+    unsigned char h6;
+
+    signed char gh1, gh3;
+    short gh2;
+
+    unsigned char res_heat_range;
+    signed char res_heat_val;
+    // -8 to 7
+    signed char range_sw_err;
+};
+
+// The calibration of a sensor at room conditions, used if bme680_sim_add gets NULL
+extern const struct bme680_sim_calib bme680_sim_default_calib;
+
+// Attach an emulated BME680 to the simulated I²C bus (i2c_sim.h), with its calibration registers
+// filled in and a finished measurement of the given raw values ready
+int bme680_sim_add(int bus, int addr, const struct bme680_sim_calib *calib);
+
+// Set the raw ADC values the next burst read returns
+void bme680_sim_set_adc(int bus, int addr, unsigned int temp_adc, unsigned int pres_adc, unsigned short hum_adc);
+// Set the raw gas ADC value and range, marked valid and with a stable heater
+void bme680_sim_set_gas(int bus, int addr, unsigned short gas_adc, unsigned int range);
+
+
+#endif
@@ -1,79 +1,717 @@
+// for sched_setaffinity and cpu_set_t
+#define _GNU_SOURCE
+
 #include "sensors.h"
 
+#include <poll.h>
+#include <sched.h>
+#include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <sys/mman.h>
+
+#include "raw_log.h"
+#include "sample_bus.h"
+#include "../interfaces/errlog.h"
 #include "../interfaces/gpio.h"
+#include "../interfaces/instrument.h"
 
 
 #define DHT_PIN             17
 
 #define RETRY_WAIT_S  		2
 #define TIMEOUT_US          100
+#define MAX_ATTEMPTS        5
 
-#define CHECK_RC(rc) \
-    if (rc == GPIO_FAILURE) { \
-		sleep(RETRY_WAIT_S); \
-        continue; \
-	}
+// the start pulse driving the pin low
+#define START_PULSE_NS      20000000ULL
 
+// the edges of one transmission: start response, 40 bits, and the release
+#define MAX_EDGES           128
+// no edge for this long ends the transmission
+#define EDGE_TIMEOUT_MS     5
+
+// DHT22_MODE_SAMPLED samples every 2 µs over the start pulse and the ~5 ms transmission
+#define SAMPLE_PERIOD_NS    2000
+#define SAMPLE_WINDOW_NS    6000000ULL
+#define SAMPLE_COUNT        ((START_PULSE_NS + SAMPLE_WINDOW_NS) / SAMPLE_PERIOD_NS)
+
+// the nominal high pulse widths of a 0 and a 1
+#define PULSE_0_US          27
+#define PULSE_1_US          70
+
+// the fixed 0/1 threshold if the pulses do not form two clusters (all bits equal)
+#define PULSE_THRESHOLD_US  50
+// the minimum distance between the 0 and 1 cluster centers
+#define MIN_CLUSTER_GAP_US  20
+
+
+// the statistics of each mode
+static struct dht22_stats stats[DHT22_MODE_COUNT];
+
+// the core DHT22_MODE_REALTIME runs on
+static int realtime_cpu = 3;
+
+// the realtime setup steps that failed before (a bit per errlog code), each is reported once
+// instead of on every attempt
+static unsigned int realtime_reported;
+
+// whether the first realtime read checked for and took the memory lock, which then stays for the
+// later ones, so they skip reading /proc/self/status and the mlockall/munlockall calls
+static int memory_checked;
+
+// the scheduling state of the calling thread before DHT22_MODE_REALTIME changed it
+struct sched_state {
+    int policy;
+    struct sched_param param;
+    cpu_set_t cpus;
+};
+
+
+// adds the deviation of a high pulse from its nominal width to the jitter histogram
+static void record_pulse(struct dht22_stats* st, unsigned int high_us, int bit) {
+    unsigned int nominal = bit ? PULSE_1_US : PULSE_0_US;
+    unsigned int dev = high_us > nominal ? high_us - nominal : nominal - high_us;
+
+    st->jitter[dev < DHT22_JITTER_BUCKETS ? dev : DHT22_JITTER_BUCKETS - 1]++;
+}
+
+static void report_realtime(enum errlog_code code, int err, int arg) {
+    unsigned int bit = 1u << (code - ERR_DHT22_AFFINITY);
+
+    if (!(realtime_reported & bit))
+        errlog_record(code, err, arg);
+
+    realtime_reported |= bit;
+}
+
+// gets the memory the process has locked (VmLck) in kB, -1 if it is unknown
+static long locked_kb(void) {
+    FILE* f = fopen("/proc/self/status", "r");
+    if (!f)
+        return -1;
+
+    long kb = -1;
+    char line[128];
+    while (fgets(line, sizeof(line), f))
+        if (sscanf(line, "VmLck: %ld", &kb) == 1)
+            break;
+
+    fclose(f);
+
+    return kb;
+}
+
+// pins the calling thread to realtime_cpu, elevates it to SCHED_FIFO, and locks its memory,
+// each step is best effort since it may lack the privileges
+static void enter_realtime(struct sched_state* saved) {
+    saved->policy = sched_getscheduler(0);
+    sched_getparam(0, &saved->param);
+    sched_getaffinity(0, sizeof(saved->cpus), &saved->cpus);
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(realtime_cpu, &cpus);
+
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) == -1)
+        report_realtime(ERR_DHT22_AFFINITY, errno, realtime_cpu);
+
+    const struct sched_param param = { .sched_priority = sched_get_priority_max(SCHED_FIFO) };
+    if (sched_setscheduler(0, SCHED_FIFO, &param) == -1)
+        report_realtime(ERR_DHT22_SCHED, errno, 0);
+
+    // avoid page faults while measuring the pulses, unless the process already locked its memory
+    // or it can not be told whether it did; checked once, the lock is kept for the later reads
+    if (!memory_checked) {
+        memory_checked = 1;
+
+        if (locked_kb() == 0 && mlockall(MCL_CURRENT | MCL_FUTURE) == -1)
+            report_realtime(ERR_DHT22_LOCK, errno, 0);
+    }
+}
+
+// restores the scheduling state saved by enter_realtime, the memory stays locked
+static void leave_realtime(const struct sched_state* saved) {
+    sched_setscheduler(0, saved->policy, &saved->param);
+    sched_setaffinity(0, sizeof(saved->cpus), &saved->cpus);
+}
+
+// converts a received 5-byte frame, returns -1 if the checksum does not match
+static int convert_frame(const uint8_t frame[5], float* temp, float* hum) {
+    if (((frame[0] + frame[1] + frame[2] + frame[3]) & 0xFF) != frame[4])
+        return -1;
+
+    uint16_t h = (frame[0] << 8) | frame[1];
+    int16_t  t = ((frame[2] & 0x7F) << 8) | frame[3];
+
+    // the highest bit is the sign of the temperature
+    if (frame[2] & 0x80)
+        t = -t;
+
+    *temp = t / 10.0F;
+    *hum  = h / 10.0F;
+
+    return 0;
+}
+
+// classifies the 40 high pulses into bits and packs them into the frame, MSB first;
+// the 0/1 threshold is the midpoint of the two clusters of pulse widths (1D 2-means),
+// returns the confidence margin: the distance of the closest pulse to the threshold
+// relative to half the distance between the clusters, 1 is ideal and 0 is ambiguous
+static float decode_pulses(const unsigned int high_us[40], uint8_t frame[5], struct dht22_stats* st) {
+    unsigned int min = high_us[0], max = high_us[0];
+    for (int i = 1; i < 40; i++) {
+        if (high_us[i] < min) min = high_us[i];
+        if (high_us[i] > max) max = high_us[i];
+    }
+
+    float c0 = min, c1 = max;
+    float threshold = PULSE_THRESHOLD_US;
+
+    if (max - min >= MIN_CLUSTER_GAP_US) {
+        for (int iter = 0; iter < 8; iter++) {
+            threshold = (c0 + c1) / 2;
+
+            unsigned int sum0 = 0, sum1 = 0, n0 = 0, n1 = 0;
+            for (int i = 0; i < 40; i++) {
+                if (high_us[i] >= threshold) { sum1 += high_us[i]; n1++; }
+                else                         { sum0 += high_us[i]; n0++; }
+            }
+
+            float n_c0 = (float)sum0 / n0, n_c1 = (float)sum1 / n1;
+            if (n_c0 == c0 && n_c1 == c1)
+                break;
+
+            c0 = n_c0;
+            c1 = n_c1;
+        }
+
+        threshold = (c0 + c1) / 2;
+    }
+    else {
+        // all bits are equal, both clusters are the nominal widths
+        c0 = PULSE_0_US;
+        c1 = PULSE_1_US;
+    }
+
+    float closest = threshold;
+
+    for (int i = 0; i < 5; i++)
+        frame[i] = 0;
+
+    for (int i = 0; i < 40; i++) {
+        int bit = high_us[i] >= threshold;
+        frame[i / 8] |= bit << (7 - i % 8);
+
+        record_pulse(st, high_us[i], bit);
+
+        float dist = bit ? high_us[i] - threshold : threshold - high_us[i];
+        if (dist < closest)
+            closest = dist;
+    }
+
+    float margin = closest / ((c1 - c0) / 2);
+
+    return margin > 1 ? 1 : margin;
+}
+
+// an asynchronous read, advanced by dht22_step
+struct dht22 {
+    enum dht22_mode mode;
+    enum {
+        STATE_IDLE,
+        // the start pulse is driving the pin low
+        STATE_START,
+        // the edges of the transmission are being collected
+        STATE_CAPTURE,
+        // waiting before the next attempt
+        STATE_BACKOFF,
+        STATE_DONE,
+        STATE_FAILED
+    } state;
+
+    // when dht22_step has to be called next, CLOCK_MONOTONIC in ns
+    unsigned long long deadline;
+    int attempt;
+
+    // the edge watcher during STATE_CAPTURE, -1 otherwise
+    int fd;
+    struct GPIO_edgeEvent events[MAX_EDGES];
+    unsigned int count;
+
+    // the sampling thread of DHT22_MODE_SAMPLED, running from STATE_START to the end of STATE_CAPTURE
+    struct GPIO_sampler sampler;
+    int sampling;
+    unsigned int samples[(SAMPLE_COUNT + 31) / 32];
+
+    float temp, hum, margin;
+
+    // where the results are published, if set
+    struct sample_bus *bus;
+    unsigned int sensor_id;
+
+    // where the pulse widths of every captured transmission are logged, if set
+    struct raw_log *log;
+    unsigned int log_id;
+};
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// releases the line and captures the high pulse widths of one transmission by polling the pin level
+static int capture_poll(unsigned int high_us[40]) {
+    int rc = GPIO_FAILURE;
+
+    GPIO_output(DHT_PIN, GPIO_HIGH);
+    GPIO_setup(DHT_PIN, GPIO_IN);
+
+    if (GPIO_pollForState(DHT_PIN, GPIO_LOW,  TIMEOUT_US) == GPIO_FAILURE ||
+        GPIO_pollForState(DHT_PIN, GPIO_HIGH, TIMEOUT_US) == GPIO_FAILURE ||
+        GPIO_pollForState(DHT_PIN, GPIO_LOW,  TIMEOUT_US) == GPIO_FAILURE)
+        goto out;
+
+    for (int i = 0; i < 40; i++) {
+        if (GPIO_pollForState(DHT_PIN, GPIO_HIGH, TIMEOUT_US) == GPIO_FAILURE)
+            goto out;
+
+        int time = GPIO_pollForState(DHT_PIN, GPIO_LOW, TIMEOUT_US);
+        if (time == GPIO_FAILURE)
+            goto out;
+
+        high_us[i] = time;
+    }
+
+    rc = GPIO_SUCCESS;
+
+out:
+    GPIO_setup(DHT_PIN, GPIO_OUT);
+    GPIO_output(DHT_PIN, GPIO_HIGH);
+
+    return rc;
+}
+
+// extracts the high pulse widths from the captured edges
+static int edges_to_pulses(const struct GPIO_edgeEvent* events, unsigned int count, unsigned int high_us[40]) {
+    unsigned int pulses[MAX_EDGES / 2];
+    unsigned int highs = 0;
+
+    if (count > MAX_EDGES)
+        count = MAX_EDGES;
+
+    for (unsigned int i = 0; i + 1 < count; i++)
+        if (events[i].edge == GPIO_RISING && events[i + 1].edge == GPIO_FALLING)
+            pulses[highs++] = (events[i + 1].timestamp_ns - events[i].timestamp_ns) / 1000;
+
+    // the data bits are the last 40 high pulses, the response pulse before them may be missed
+    if (highs < 40)
+        return GPIO_FAILURE;
+
+    memcpy(high_us, &pulses[highs - 40], 40 * sizeof(*high_us));
+
+    return GPIO_SUCCESS;
+}
+
+// extracts the high pulse widths from the run lengths of the samples
+static int samples_to_pulses(const struct dht22* dev, unsigned int high_us[40]) {
+    unsigned int runs[MAX_EDGES];
+    enum GPIO_STATE level;
+
+    int count = GPIO_samplerRuns(&dev->sampler, runs, MAX_EDGES, &level);
+    if (count == GPIO_FAILURE)
+        return GPIO_FAILURE;
+
+    unsigned int pulses[MAX_EDGES / 2];
+    unsigned int highs = 0;
+
+    // the last run is cut off by the end of the window, every high run before it is a complete pulse
+    for (int i = 0; i + 1 < count; i++, level = !level)
+        if (level == GPIO_HIGH)
+            pulses[highs++] = runs[i] * SAMPLE_PERIOD_NS / 1000;
+
+    // the data bits are the last 40 high pulses, before them are the release and the response pulse
+    if (highs < 40)
+        return GPIO_FAILURE;
+
+    memcpy(high_us, &pulses[highs - 40], 40 * sizeof(*high_us));
+
+    return GPIO_SUCCESS;
+}
+
+// drives the start pulse of the next attempt
+static void start_attempt(struct dht22* dev) {
+    stats[dev->mode].attempts++;
+    dev->attempt++;
+
+    GPIO_setup(DHT_PIN, GPIO_OUT);
+    GPIO_output(DHT_PIN, GPIO_LOW);
+
+    // the sampling starts with the start pulse and releases the line itself, so the window after
+    // the release is complete however late step_start runs
+    if (dev->mode == DHT22_MODE_SAMPLED)
+        dev->sampling = GPIO_samplerStart(&dev->sampler) == GPIO_SUCCESS;
+
+    dev->state = STATE_START;
+    dev->deadline = now_ns() + START_PULSE_NS;
+}
+
+// decodes a captured attempt, then finishes or backs off before the next one
+static void finish_attempt(struct dht22* dev, int rc, unsigned int high_us[40]) {
+    if (rc == GPIO_SUCCESS) {
+        // log the transmission before decoding it, so failed decodes can be reprocessed as well
+        if (dev->log) {
+            uint8_t raw[80];
+            for (int i = 0; i < 40; i++) {
+                unsigned int width = high_us[i] > 0xFFFF ? 0xFFFF : high_us[i];
+
+                raw[2 * i]     = width & 0xFF;
+                raw[2 * i + 1] = width >> 8;
+            }
+
+            raw_log_append(dev->log, RAW_LOG_DHT22, dev->log_id, now_ns(), raw, sizeof(raw));
+        }
+
+        uint8_t frame[5];
+        dev->margin = decode_pulses(high_us, frame, &stats[dev->mode]);
+
+        if (convert_frame(frame, &dev->temp, &dev->hum) == 0) {
+            stats[dev->mode].reads++;
+            dev->state = STATE_DONE;
+
+            if (dev->bus) {
+                const struct sample sample = {
+                    dev->sensor_id, 2, now_ns(), { dev->temp, dev->hum }
+                };
+                sample_bus_publish(dev->bus, &sample);
+            }
+
+            return;
+        }
+    }
+
+    if (dev->attempt == MAX_ATTEMPTS) {
+        stats[dev->mode].failures++;
+        dev->state = STATE_FAILED;
+
+        return;
+    }
+
+    INSTR_COUNT(INSTR_DHT22_RETRY);
+
+    dev->state = STATE_BACKOFF;
+    dev->deadline = now_ns() + RETRY_WAIT_S * 1000000000ULL;
+}
+
+static void step_start(struct dht22* dev) {
+    unsigned int high_us[40];
+
+    if (dev->mode == DHT22_MODE_EDGES) {
+        // requesting the pin for edge events turns it into an input and releases the line
+        dev->fd = GPIO_watchEdges(DHT_PIN, GPIO_BOTH);
+        if (dev->fd == GPIO_FAILURE) {
+            GPIO_output(DHT_PIN, GPIO_HIGH);
+            finish_attempt(dev, GPIO_FAILURE, high_us);
+
+            return;
+        }
+
+        dev->count = 0;
+        dev->state = STATE_CAPTURE;
+        dev->deadline = now_ns() + EDGE_TIMEOUT_MS * 1000000ULL;
+
+        return;
+    }
+
+    if (dev->mode == DHT22_MODE_SAMPLED) {
+        if (!dev->sampling) {
+            GPIO_output(DHT_PIN, GPIO_HIGH);
+            finish_attempt(dev, GPIO_FAILURE, high_us);
+
+            return;
+        }
+
+        // the sampler released the line, the transmission is decoded once the sampling window ended
+        dev->state = STATE_CAPTURE;
+        dev->deadline += SAMPLE_WINDOW_NS;
+
+        return;
+    }
+
+    // the polling modes capture the ~5 ms transmission synchronously
+    int rc;
+    if (dev->mode == DHT22_MODE_REALTIME) {
+        struct sched_state saved;
+
+        enter_realtime(&saved);
+        rc = capture_poll(high_us);
+        leave_realtime(&saved);
+    }
+    else
+        rc = capture_poll(high_us);
+
+    finish_attempt(dev, rc, high_us);
+}
+
+static void step_capture(struct dht22* dev) {
+    unsigned int high_us[40];
+
+    if (dev->mode == DHT22_MODE_SAMPLED) {
+        if (now_ns() < dev->deadline)
+            return;
+
+        int rc = GPIO_samplerWait(&dev->sampler);
+        dev->sampling = 0;
+
+        GPIO_setup(DHT_PIN, GPIO_OUT);
+        GPIO_output(DHT_PIN, GPIO_HIGH);
+
+        finish_attempt(dev, rc == GPIO_SUCCESS ? samples_to_pulses(dev, high_us) : rc, high_us);
+
+        return;
+    }
+
+    // read the queued edges without blocking, each one extends the deadline
+    while (dev->count < MAX_EDGES) {
+        int n = GPIO_readEdges(dev->fd, &dev->events[dev->count], MAX_EDGES - dev->count, 0);
+        if (n <= 0)
+            break;
+
+        dev->count += n;
+        dev->deadline = now_ns() + EDGE_TIMEOUT_MS * 1000000ULL;
+    }
+
+    // the transmission ends when no edge came for EDGE_TIMEOUT_MS
+    if (dev->count < MAX_EDGES && now_ns() < dev->deadline)
+        return;
+
+    GPIO_unwatchEdges(dev->fd);
+    dev->fd = -1;
+
+    GPIO_setup(DHT_PIN, GPIO_OUT);
+    GPIO_output(DHT_PIN, GPIO_HIGH);
+
+    finish_attempt(dev, edges_to_pulses(dev->events, dev->count, high_us), high_us);
+}
+
+struct dht22* dht22_open(enum dht22_mode mode) {
+    if ((unsigned int)mode >= DHT22_MODE_COUNT) {
+        errlog_record(ERR_DHT22_MODE, 0, mode);
+        return NULL;
+    }
 
-int read_dht22_data(float* temp, float* hum) {
     if (GPIO_init() != GPIO_SUCCESS)
+        return NULL;
+
+    struct dht22* dev = malloc(sizeof(*dev));
+    if (!dev)
+        return NULL;
+
+    dev->mode     = mode;
+    dev->state    = STATE_IDLE;
+    dev->fd       = -1;
+    dev->sampling = 0;
+    dev->margin   = 0;
+    dev->bus      = NULL;
+    dev->log      = NULL;
+
+    dev->sampler.pin       = DHT_PIN;
+    dev->sampler.period_ns = SAMPLE_PERIOD_NS;
+    dev->sampler.cpu       = realtime_cpu;
+    dev->sampler.realtime  = sysconf(_SC_NPROCESSORS_ONLN) > 1;
+    dev->sampler.source    = NULL;
+    dev->sampler.release   = START_PULSE_NS / SAMPLE_PERIOD_NS;
+    dev->sampler.samples   = dev->samples;
+    dev->sampler.count     = SAMPLE_COUNT;
+
+    return dev;
+}
+
+int dht22_close(struct dht22* dev) {
+    int rc = 0;
+
+    // an interrupted capture still holds the pin
+    if (dev->fd != -1 || dev->sampling) {
+        if (dev->fd != -1)
+            rc = GPIO_unwatchEdges(dev->fd);
+        else
+            rc = GPIO_samplerWait(&dev->sampler);
+
+        GPIO_setup(DHT_PIN, GPIO_OUT);
+        GPIO_output(DHT_PIN, GPIO_HIGH);
+    }
+
+    free(dev);
+
+    return rc;
+}
+
+int dht22_start(struct dht22* dev) {
+    if (dev->state != STATE_IDLE && dev->state != STATE_DONE && dev->state != STATE_FAILED) {
+        errlog_record(ERR_DHT22_BUSY, 0, 0);
         return -1;
+    }
+
+    dev->attempt = 0;
+    dev->margin  = 0;
+    start_attempt(dev);
+
+    return SENSOR_PENDING;
+}
+
+int dht22_step(struct dht22* dev) {
+    switch (dev->state) {
+        case STATE_START:
+            if (now_ns() >= dev->deadline)
+                step_start(dev);
+        break;
+
+        case STATE_CAPTURE:
+            step_capture(dev);
+        break;
+
+        case STATE_BACKOFF:
+            if (now_ns() >= dev->deadline)
+                start_attempt(dev);
+        break;
+
+        case STATE_DONE:
+            return 0;
+
+        case STATE_IDLE:
+        case STATE_FAILED:
+            return -1;
+    }
 
-	for (int n = 0; n < 5; n++) {
-		GPIO_setup(DHT_PIN, GPIO_OUT);
-		GPIO_output(DHT_PIN, GPIO_LOW);
-		usleep(20000);
+    return dev->state == STATE_DONE ? 0 : dev->state == STATE_FAILED ? -1 : SENSOR_PENDING;
+}
+
+void dht22_set_bus(struct dht22* dev, struct sample_bus* bus, unsigned int sensor_id) {
+    dev->bus = bus;
+    dev->sensor_id = sensor_id;
+}
 
-		GPIO_output(DHT_PIN, GPIO_HIGH);
-		GPIO_setup(DHT_PIN, GPIO_IN);
+void dht22_set_log(struct dht22* dev, struct raw_log* log, unsigned int sensor_id) {
+    dev->log = log;
+    dev->log_id = sensor_id;
+}
 
-        CHECK_RC(GPIO_pollForState(DHT_PIN, GPIO_LOW,  TIMEOUT_US));
-        CHECK_RC(GPIO_pollForState(DHT_PIN, GPIO_HIGH, TIMEOUT_US));
-        CHECK_RC(GPIO_pollForState(DHT_PIN, GPIO_LOW,  TIMEOUT_US));
+// decodes logged pulse widths like a read does, without counting them in the statistics
+int dht22_decode_raw(const void* raw, unsigned int length, float* temp, float* hum, float* margin) {
+    if (length != 80) {
+        errlog_record(ERR_DHT22_RAW_LENGTH, 0, length);
+        return -1;
+    }
 
-		uint8_t data[40];
-		for (int i = 0; i < 40; i++) {
-			CHECK_RC(GPIO_pollForState(DHT_PIN, GPIO_HIGH, TIMEOUT_US));
+    const uint8_t* bytes = raw;
+    unsigned int high_us[40];
+    for (int i = 0; i < 40; i++)
+        high_us[i] = bytes[2 * i] | bytes[2 * i + 1] << 8;
 
-            int time = GPIO_pollForState(DHT_PIN, GPIO_LOW, TIMEOUT_US);
-            CHECK_RC(time);
+    struct dht22_stats scratch = { 0 };
+    uint8_t frame[5];
 
-			data[i] = time >= 50;
-		}
+    float m = decode_pulses(high_us, frame, &scratch);
+    if (convert_frame(frame, temp, hum) == -1)
+        return -1;
 
-		GPIO_setup(DHT_PIN, GPIO_OUT);
-		GPIO_output(DHT_PIN, GPIO_HIGH);
+    if (margin)
+        *margin = m;
 
-		int i = 0;
+    return 0;
+}
 
-		uint16_t h = 0;
-		for (int j = 15; j >= 0; j--)
-			h += data[i++] * (1 << j);
-		i++;
+// decodes captured edges like a DHT22_MODE_EDGES read does, without counting them in the statistics
+int dht22_decode_edges(const struct GPIO_edgeEvent* events, unsigned int count, float* temp, float* hum, float* margin) {
+    unsigned int high_us[40];
+    if (edges_to_pulses(events, count, high_us) == GPIO_FAILURE)
+        return -1;
 
-		uint16_t t = 0;
-		for (int j = 14; j >= 0; j--)
-			t += data[i++] * (1 << j);
+    struct dht22_stats scratch = { 0 };
+    uint8_t frame[5];
 
-		if (data[16])
-			t = -t;
+    float m = decode_pulses(high_us, frame, &scratch);
+    if (convert_frame(frame, temp, hum) == -1)
+        return -1;
 
-		uint8_t checksum = 0;
-		for (int j = 7; j >= 0; j--)
-			checksum += data[i++] * (1 << j);
+    if (margin)
+        *margin = m;
 
-		if ((((h >> 8) + (h & 0xFF) + (t >> 8) + (t & 0xFF)) & 0xFF) == checksum) {
-			*temp = t / 10.0F;
-			*hum = h / 10.0F;
+    return 0;
+}
 
-			return 0;
-		}
+int dht22_fd(const struct dht22* dev) {
+    return dev->fd;
+}
 
-		sleep(RETRY_WAIT_S);
-	}
+unsigned long long dht22_deadline(const struct dht22* dev) {
+    return dev->deadline;
+}
 
-    return -1;
+int dht22_result(const struct dht22* dev, float* temp, float* hum, float* margin) {
+    if (margin)
+        *margin = dev->margin;
+
+    if (dev->state != STATE_DONE)
+        return -1;
+
+    *temp = dev->temp;
+    *hum  = dev->hum;
+
+    return 0;
+}
+
+int dht22_read(enum dht22_mode mode, float* temp, float* hum, float* margin) {
+    INSTR_START(start);
+
+    struct dht22* dev = dht22_open(mode);
+    if (!dev)
+        return -1;
+
+    int rc = dht22_start(dev);
+    while (rc == SENSOR_PENDING) {
+        // wait for the next edges or the deadline
+        long long wait_ns = dht22_deadline(dev) - now_ns();
+
+        if (dev->fd != -1) {
+            struct pollfd p = { .fd = dev->fd, .events = POLLIN };
+            poll(&p, 1, wait_ns > 0 ? (wait_ns + 999999) / 1000000 : 0);
+        }
+        else if (wait_ns > 0) {
+            struct timespec ts = { wait_ns / 1000000000, wait_ns % 1000000000 };
+            nanosleep(&ts, NULL);
+        }
+
+        rc = dht22_step(dev);
+    }
+
+    rc = dht22_result(dev, temp, hum, margin);
+    dht22_close(dev);
+
+    INSTR_END(INSTR_DHT22_READ, start, rc == 0);
+
+    return rc;
+}
+
+void dht22_set_realtime_cpu(int cpu) {
+    realtime_cpu = cpu;
+}
+
+void dht22_get_stats(enum dht22_mode mode, struct dht22_stats* out) {
+    *out = stats[mode];
+}
+
+void dht22_reset_stats(void) {
+    memset(stats, 0, sizeof(stats));
+}
+
+int read_dht22_data(float* temp, float* hum) {
+    return dht22_read(DHT22_MODE_POLL, temp, hum, NULL);
 }
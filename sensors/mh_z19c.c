@@ -1,60 +1,271 @@
-#include "sensors.h"
-
-#include <stdio.h>
-#include <stdint.h>
-
-#include "../interfaces/serial.h"
-
-
-static uint8_t calc_checksum(uint8_t *data) {
-    uint8_t checksum = 0;
-
-    for (int i = 1; i < 8; i++)
-        checksum += data[i];
-
-    return 0xFF - checksum + 0x01;
-}
-
-int read_z19c_data(unsigned short *co2) {
-    int rc = -1;
-
-    int ser = serial_open("/dev/ttyS0", B9600);
-    if (ser == -1)
-        goto out;
-
-    const uint8_t cmd[] = {
-        0xFF, 0x01, 0x86, 0x00, 0x00, 0x00, 0x00, 0x00, 0x79
-    };
-
-    if (serial_write(ser, cmd, sizeof(cmd)) == -1)
-        goto serial_close;
-
-    uint8_t ret[9];
-    if (serial_read(ser, ret, sizeof(ret)) == -1)
-        goto serial_close;
-
-    if (ret[0] != 0xFF) {
-        fprintf(stderr, "Expected first byte 0xFF, got 0x%X.\n", ret[0]);
-        goto serial_close;
-    }
-
-    if (ret[1] != 0x86) {
-        fprintf(stderr, "Expected second byte 0x86, got 0x%X.\n", ret[1]);
-        goto serial_close;
-    }
-
-    uint8_t checksum = calc_checksum(ret);
-    if (ret[8] != checksum) {
-        fprintf(stderr, "Expected checksum 0x%X, got 0x%X.\n", checksum, ret[8]);
-        goto serial_close;
-    }
-
-    *co2 = ret[2] * 256 + ret[3];
-    rc = 0;
-
-serial_close:
-    serial_close(ser);
-
-out:
-    return rc;
-}
+#include "sensors.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "raw_log.h"
+#include "sample_bus.h"
+#include "../interfaces/errlog.h"
+#include "../interfaces/instrument.h"
+#include "../interfaces/serial.h"
+
+
+// how long z19c_read waits for the response by default
+#define READ_TIMEOUT_MS 1000
+
+// the serial port read_z19c_data opens
+static const char *default_path = "/dev/ttyS0";
+
+// an open MH-Z19C session
+struct z19c {
+    // the serial file descriptor, kept open and configured for the whole session
+    int ser;
+
+    // the bytes of the frame being assembled
+    uint8_t frame[9];
+    unsigned int len;
+
+    // the state of the read started by z19c_start
+    int pending;
+    unsigned long long deadline;
+
+    // the result of the last read
+    int rc;
+    unsigned short co2;
+
+    // where the results are published, if set
+    struct sample_bus *bus;
+    unsigned int sensor_id;
+
+    // where the response frames are logged, if set
+    struct raw_log *log;
+    unsigned int log_id;
+};
+
+static uint8_t calc_checksum(const uint8_t *data) {
+    uint8_t checksum = 0;
+
+    for (int i = 1; i < 8; i++)
+        checksum += data[i];
+
+    return 0xFF - checksum + 0x01;
+}
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// adds a received byte to the frame, returns 1 once a complete frame with a valid checksum is assembled
+static int assemble(struct z19c *dev, uint8_t b) {
+    dev->frame[dev->len++] = b;
+
+    // a frame starts with 0xFF 0x86
+    if (dev->len == 1 && b != 0xFF)
+        dev->len = 0;
+    else if (dev->len == 2 && b != 0x86)
+        dev->len = b == 0xFF ? 1 : 0;
+
+    if (dev->len < sizeof(dev->frame))
+        return 0;
+
+    uint8_t checksum = calc_checksum(dev->frame);
+    if (dev->frame[8] == checksum)
+        return 1;
+
+    errlog_record(ERR_Z19C_CHECKSUM, 0, dev->frame[8]);
+
+    // resynchronize by assembling the rejected frame again from its second byte,
+    // 8 bytes can not complete a frame so this does not recurse further
+    uint8_t rejected[sizeof(dev->frame)];
+    memcpy(rejected, dev->frame, sizeof(rejected));
+
+    dev->len = 0;
+    for (unsigned int i = 1; i < sizeof(rejected); i++)
+        assemble(dev, rejected[i]);
+
+    return 0;
+}
+
+// opens a session to the MH-Z19C at a serial port
+struct z19c *z19c_open(const char *path) {
+    struct z19c *dev = malloc(sizeof(*dev));
+    if (!dev)
+        return NULL;
+
+    dev->ser = serial_open_nonblock(path, B9600);
+    if (dev->ser == -1) {
+        free(dev);
+        return NULL;
+    }
+
+    dev->len = 0;
+    dev->pending = 0;
+    dev->rc = -1;
+    dev->bus = NULL;
+    dev->log = NULL;
+
+    return dev;
+}
+
+// closes a session opened by z19c_open
+int z19c_close(struct z19c *dev) {
+    int ret = serial_close(dev->ser);
+    free(dev);
+
+    return ret;
+}
+
+// sends the read command, z19c_step then collects the response without blocking,
+// waits up to timeout ms (negative for the default) for the response
+int z19c_start(struct z19c *dev, int timeout) {
+    const uint8_t cmd[] = {
+        0xFF, 0x01, 0x86, 0x00, 0x00, 0x00, 0x00, 0x00, 0x79
+    };
+
+    dev->pending = 0;
+    dev->rc = -1;
+
+    // drop the rest of earlier responses
+    serial_flush(dev->ser);
+    dev->len = 0;
+
+    if (serial_write(dev->ser, cmd, sizeof(cmd)) == -1)
+        return -1;
+
+    dev->pending  = 1;
+    dev->deadline = now_ns() + (timeout < 0 ? READ_TIMEOUT_MS : timeout) * 1000000ULL;
+
+    return SENSOR_PENDING;
+}
+
+// reads the received bytes, returns SENSOR_PENDING, 0, or -1
+int z19c_step(struct z19c *dev) {
+    if (!dev->pending)
+        return dev->rc;
+
+    for (;;) {
+        uint8_t buff[32];
+        int n = serial_read(dev->ser, buff, sizeof(buff));
+        if (n == -1) {
+            dev->pending = 0;
+            return dev->rc;
+        }
+
+        if (n == 0)
+            break;
+
+        for (int i = 0; i < n; i++) {
+            if (!assemble(dev, buff[i]))
+                continue;
+
+            if (dev->log)
+                raw_log_append(dev->log, RAW_LOG_Z19C, dev->log_id, now_ns(), dev->frame, sizeof(dev->frame));
+
+            dev->co2 = dev->frame[2] * 256 + dev->frame[3];
+            dev->len = 0;
+
+            dev->pending = 0;
+            dev->rc = 0;
+
+            if (dev->bus) {
+                const struct sample sample = { dev->sensor_id, 1, now_ns(), { dev->co2 } };
+                sample_bus_publish(dev->bus, &sample);
+            }
+
+            return 0;
+        }
+    }
+
+    if (now_ns() < dev->deadline)
+        return SENSOR_PENDING;
+
+    errlog_record(ERR_Z19C_TIMEOUT, 0, dev->len);
+    dev->pending = 0;
+
+    return dev->rc;
+}
+
+int z19c_fd(const struct z19c *dev) {
+    return dev->ser;
+}
+
+void z19c_set_bus(struct z19c *dev, struct sample_bus *bus, unsigned int sensor_id) {
+    dev->bus = bus;
+    dev->sensor_id = sensor_id;
+}
+
+void z19c_set_log(struct z19c *dev, struct raw_log *log, unsigned int sensor_id) {
+    dev->log = log;
+    dev->log_id = sensor_id;
+}
+
+// checks and decodes a logged response frame
+int z19c_decode_raw(const void *raw, unsigned int length, unsigned short *co2) {
+    const uint8_t *frame = raw;
+
+    if (length != 9 || frame[0] != 0xFF || frame[1] != 0x86 || frame[8] != calc_checksum(frame)) {
+        errlog_record(ERR_Z19C_FRAME, 0, 0);
+        return -1;
+    }
+
+    *co2 = frame[2] * 256 + frame[3];
+
+    return 0;
+}
+
+unsigned long long z19c_deadline(const struct z19c *dev) {
+    return dev->deadline;
+}
+
+// gets the CO₂ concentration of the last read
+int z19c_result(const struct z19c *dev, unsigned short *co2) {
+    if (dev->pending || dev->rc != 0)
+        return -1;
+
+    *co2 = dev->co2;
+
+    return 0;
+}
+
+// reads the CO₂ concentration, waits up to timeout ms (negative for the default) for the response
+int z19c_read(struct z19c *dev, unsigned short *co2, int timeout) {
+    INSTR_START(start);
+
+    int rc = z19c_start(dev, timeout);
+    while (rc == SENSOR_PENDING) {
+        long long left = z19c_deadline(dev) - now_ns();
+        if (serial_wait(dev->ser, left > 0 ? (left + 999999) / 1000000 : 0) == -1) {
+            rc = -1;
+            break;
+        }
+
+        rc = z19c_step(dev);
+    }
+
+    rc = rc == 0 ? z19c_result(dev, co2) : -1;
+    INSTR_END(INSTR_Z19C_READ, start, rc == 0);
+
+    return rc;
+}
+
+void z19c_set_path(const char *path) {
+    default_path = path ? path : "/dev/ttyS0";
+}
+
+int read_z19c_data(unsigned short *co2) {
+    struct z19c *dev = z19c_open(default_path);
+    if (!dev)
+        return -1;
+
+    int rc = z19c_read(dev, co2, -1);
+
+    z19c_close(dev);
+
+    return rc;
+}
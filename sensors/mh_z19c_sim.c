@@ -0,0 +1,230 @@
+#include "mh_z19c_sim.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "../interfaces/errlog.h"
+
+
+// how often the thread checks whether it should stop
+#define STOP_POLL_MS 50
+
+struct z19c_sim {
+    // the emulator's side of the terminal and the path of the other side
+    int master;
+    int slave;
+    char path[64];
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    int stop;
+
+    struct z19c_sim_config config;
+    struct z19c_sim_stats stats;
+
+    // the bytes of the command being assembled
+    uint8_t cmd[9];
+    unsigned int len;
+};
+
+static uint8_t calc_checksum(const uint8_t *data) {
+    uint8_t checksum = 0;
+
+    for (int i = 1; i < 8; i++)
+        checksum += data[i];
+
+    return 0xFF - checksum + 0x01;
+}
+
+static void sleep_ms(unsigned int ms) {
+    if (ms)
+        usleep(ms * 1000);
+}
+
+// answers the read command, the nth one since the start (counted under the lock by execute)
+static void respond(struct z19c_sim *sim, const struct z19c_sim_config *config, unsigned long reads) {
+    uint8_t resp[9] = { 0xFF, 0x86, config->co2 >> 8, config->co2 & 0xFF, 0x40, 0x00, 0x00, 0x00, 0x00 };
+    resp[8] = calc_checksum(resp);
+
+    if (config->corrupt_every && reads % config->corrupt_every == 0)
+        resp[8] ^= 0x5A;
+
+    sleep_ms(config->delay_ms);
+
+    // garbage cycles through 0x11-0xEE, it is never 0xFF or 0x86 and can not be mistaken for a frame
+    for (unsigned int i = 0; i < config->garbage; i++) {
+        uint8_t b = 0x11 * (i % 14 + 1);
+        write(sim->master, &b, 1);
+    }
+
+    unsigned int chunk = config->fragment ? config->fragment : sizeof(resp);
+    for (unsigned int off = 0; off < sizeof(resp); off += chunk) {
+        if (off)
+            sleep_ms(config->fragment_delay_ms);
+
+        write(sim->master, &resp[off], off + chunk > sizeof(resp) ? sizeof(resp) - off : chunk);
+    }
+}
+
+// handles a complete command
+static void execute(struct z19c_sim *sim) {
+    pthread_mutex_lock(&sim->lock);
+
+    struct z19c_sim_config config = sim->config;
+
+    if (sim->cmd[8] != calc_checksum(sim->cmd)) {
+        sim->stats.invalid_commands++;
+        pthread_mutex_unlock(&sim->lock);
+
+        return;
+    }
+
+    // the number of the read command, 0 for the others
+    unsigned long read = 0;
+    switch (sim->cmd[2]) {
+        case 0x86:
+            read = ++sim->stats.reads;
+        break;
+
+        // zero point calibration, the current concentration becomes 400 ppm
+        case 0x87:
+            sim->stats.zero_calibrations++;
+            sim->config.co2 = 400;
+        break;
+
+        // span point calibration
+        case 0x88:
+            sim->stats.span_calibrations++;
+            sim->stats.span = sim->cmd[3] << 8 | sim->cmd[4];
+        break;
+
+        // automatic baseline correction on (0xA0) or off (0x00)
+        case 0x79:
+            sim->stats.abc = sim->cmd[3] == 0xA0;
+        break;
+
+        default:
+            sim->stats.invalid_commands++;
+        break;
+    }
+
+    pthread_mutex_unlock(&sim->lock);
+
+    // only the read command is answered
+    if (read)
+        respond(sim, &config, read);
+}
+
+static void *serve(void *arg) {
+    struct z19c_sim *sim = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&sim->lock);
+        int stop = sim->stop;
+        pthread_mutex_unlock(&sim->lock);
+
+        if (stop)
+            break;
+
+        struct pollfd p = { .fd = sim->master, .events = POLLIN };
+        if (poll(&p, 1, STOP_POLL_MS) <= 0)
+            continue;
+
+        uint8_t buff[32];
+        int n = read(sim->master, buff, sizeof(buff));
+        if (n <= 0)
+            continue;
+
+        // a command starts with 0xFF 0x01
+        for (int i = 0; i < n; i++) {
+            sim->cmd[sim->len++] = buff[i];
+
+            if (sim->len == 1 && buff[i] != 0xFF)
+                sim->len = 0;
+            else if (sim->len == 2 && buff[i] != 0x01)
+                sim->len = buff[i] == 0xFF ? 1 : 0;
+            else if (sim->len == sizeof(sim->cmd)) {
+                execute(sim);
+                sim->len = 0;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+struct z19c_sim *z19c_sim_start(const struct z19c_sim_config *config) {
+    struct z19c_sim *sim = calloc(1, sizeof(*sim));
+    if (!sim)
+        return NULL;
+
+    if (openpty(&sim->master, &sim->slave, sim->path, NULL, NULL) == -1) {
+        errlog_record(ERR_Z19C_SIM_PTY, errno, 0);
+
+        goto free;
+    }
+
+    // pass the bytes through unchanged in both directions
+    struct termios options;
+    tcgetattr(sim->master, &options);
+    cfmakeraw(&options);
+    tcsetattr(sim->master, TCSANOW, &options);
+
+    sim->config = *config;
+    pthread_mutex_init(&sim->lock, NULL);
+
+    int rc = pthread_create(&sim->thread, NULL, serve, sim);
+    if (rc != 0) {
+        errlog_record(ERR_Z19C_SIM_START, rc, 0);
+
+        goto close;
+    }
+
+    return sim;
+
+close:
+    pthread_mutex_destroy(&sim->lock);
+    close(sim->slave);
+    close(sim->master);
+
+free:
+    free(sim);
+
+    return NULL;
+}
+
+const char *z19c_sim_path(const struct z19c_sim *sim) {
+    return sim->path;
+}
+
+void z19c_sim_configure(struct z19c_sim *sim, const struct z19c_sim_config *config) {
+    pthread_mutex_lock(&sim->lock);
+    sim->config = *config;
+    pthread_mutex_unlock(&sim->lock);
+}
+
+void z19c_sim_get_stats(struct z19c_sim *sim, struct z19c_sim_stats *stats) {
+    pthread_mutex_lock(&sim->lock);
+    *stats = sim->stats;
+    pthread_mutex_unlock(&sim->lock);
+}
+
+void z19c_sim_stop(struct z19c_sim *sim) {
+    pthread_mutex_lock(&sim->lock);
+    sim->stop = 1;
+    pthread_mutex_unlock(&sim->lock);
+
+    pthread_join(sim->thread, NULL);
+    pthread_mutex_destroy(&sim->lock);
+
+    close(sim->slave);
+    close(sim->master);
+    free(sim);
+}
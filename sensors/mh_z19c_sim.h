@@ -0,0 +1,46 @@
+#ifndef SENSORS_MH_Z19C_SIM_H
+#define SENSORS_MH_Z19C_SIM_H
+
+
+// How the emulated MH-Z19C responds
+struct z19c_sim_config {
+    // the CO₂ concentration returned by the read command (0x86)
+    unsigned short co2;
+
+    // the delay before each response
+    unsigned int delay_ms;
+    // write the response in chunks of this many bytes, 0 writes it at once
+    unsigned int fragment;
+    // write the response in chunks this far apart
+    unsigned int fragment_delay_ms;
+    // corrupt the checksum of every nth response, 0 never
+    unsigned int corrupt_every;
+    // the number of garbage bytes sent before each response
+    unsigned int garbage;
+};
+
+// What the emulated MH-Z19C received
+struct z19c_sim_stats {
+    unsigned long reads;
+    unsigned long zero_calibrations;
+    unsigned long span_calibrations;
+    unsigned long invalid_commands;
+
+    // the last span point and the automatic baseline correction state
+    unsigned short span;
+    int abc;
+};
+
+struct z19c_sim;
+
+// Start an emulated MH-Z19C on a pseudo-terminal served by its own thread
+struct z19c_sim *z19c_sim_start(const struct z19c_sim_config *config);
+// Get the path of the terminal to open instead of /dev/ttyS0
+const char *z19c_sim_path(const struct z19c_sim *sim);
+// Change the configuration of a running emulator
+void z19c_sim_configure(struct z19c_sim *sim, const struct z19c_sim_config *config);
+void z19c_sim_get_stats(struct z19c_sim *sim, struct z19c_sim_stats *stats);
+void z19c_sim_stop(struct z19c_sim *sim);
+
+
+#endif
@@ -0,0 +1,253 @@
+#include "raw_log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sensors.h"
+#include "../interfaces/errlog.h"
+
+
+#define LOG_MAGIC   "RPRAWLOG"
+#define LOG_VERSION 2
+
+// The start of a log file
+struct log_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+// The start of a record, followed by the payload padded to 8 bytes so the next header stays aligned
+struct record_header {
+    uint16_t type;
+    uint16_t length;
+    uint32_t sensor_id;
+    uint64_t timestamp_ns;
+};
+
+struct raw_log {
+    int fd;
+};
+
+// The BME680 sessions created from the calibration records during a replay
+#define REPLAY_MAX_BME680 8
+
+
+static size_t padded(size_t length) {
+    return (length + 7) & ~(size_t)7;
+}
+
+struct raw_log *raw_log_create(const char *path) {
+    struct raw_log *log = malloc(sizeof(*log));
+    if (!log)
+        return NULL;
+
+    log->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (log->fd == -1) {
+        errlog_record_detail(ERR_RAW_LOG_CREATE, errno, 0, path);
+
+        free(log);
+        return NULL;
+    }
+
+    struct log_header header = { LOG_MAGIC, LOG_VERSION, 0 };
+    if (write(log->fd, &header, sizeof(header)) != sizeof(header)) {
+        errlog_record(ERR_RAW_LOG_WRITE, errno, 0);
+
+        close(log->fd);
+        free(log);
+
+        return NULL;
+    }
+
+    return log;
+}
+
+int raw_log_append(struct raw_log *log, enum raw_log_type type, unsigned int sensor_id,
+    unsigned long long timestamp_ns, const void *data, unsigned int length) {
+    if (length > RAW_LOG_MAX_PAYLOAD) {
+        errlog_record(ERR_RAW_LOG_LENGTH, 0, length);
+        return -1;
+    }
+
+    _Alignas(8) unsigned char buff[sizeof(struct record_header) + RAW_LOG_MAX_PAYLOAD];
+    struct record_header *header = (struct record_header *)buff;
+
+    size_t size = sizeof(*header) + padded(length);
+    memset(buff, 0, size);
+
+    header->type         = type;
+    header->length       = length;
+    header->sensor_id    = sensor_id;
+    header->timestamp_ns = timestamp_ns;
+    memcpy(&buff[sizeof(*header)], data, length);
+
+    if (write(log->fd, buff, size) != (ssize_t)size) {
+        errlog_record(ERR_RAW_LOG_WRITE, errno, 0);
+        return -1;
+    }
+
+    return 0;
+}
+
+int raw_log_close(struct raw_log *log) {
+    int ret = close(log->fd);
+    free(log);
+
+    return ret;
+}
+
+int raw_log_map(struct raw_log_reader *reader, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        errlog_record_detail(ERR_RAW_LOG_OPEN, errno, 0, path);
+
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(struct log_header)) {
+        errlog_record_detail(ERR_RAW_LOG_FORMAT, 0, 0, path);
+        close(fd);
+
+        return -1;
+    }
+
+    void *mem = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mem == MAP_FAILED) {
+        errlog_record_detail(ERR_RAW_LOG_MAP, errno, 0, path);
+
+        return -1;
+    }
+
+    const struct log_header *header = mem;
+    if (memcmp(header->magic, LOG_MAGIC, sizeof(header->magic)) || header->version != LOG_VERSION) {
+        errlog_record_detail(ERR_RAW_LOG_FORMAT, 0, 0, path);
+        munmap(mem, st.st_size);
+
+        return -1;
+    }
+
+    reader->mem    = mem;
+    reader->length = st.st_size;
+    reader->offset = sizeof(*header);
+
+    return 0;
+}
+
+int raw_log_next(struct raw_log_reader *reader, struct raw_log_record *record) {
+    if (reader->length - reader->offset < sizeof(struct record_header))
+        return 0;
+
+    const struct record_header *header = (const struct record_header *)&reader->mem[reader->offset];
+    size_t size = sizeof(*header) + padded(header->length);
+
+    if (reader->length - reader->offset < size)
+        return 0;
+
+    record->type         = header->type;
+    record->sensor_id    = header->sensor_id;
+    record->timestamp_ns = header->timestamp_ns;
+    record->data         = header + 1;
+    record->length       = header->length;
+
+    reader->offset += size;
+
+    return 1;
+}
+
+void raw_log_unmap(struct raw_log_reader *reader) {
+    munmap((void *)reader->mem, reader->length);
+    reader->mem = NULL;
+}
+
+int raw_log_replay(struct raw_log_reader *reader,
+    void (*callback)(const struct sample *sample, void *arg), void *arg) {
+    struct {
+        unsigned int sensor_id;
+        struct bme680 *dev;
+    } bme680[REPLAY_MAX_BME680];
+    unsigned int bme680_count = 0;
+
+    int count = 0;
+
+    reader->offset = sizeof(struct log_header);
+
+    struct raw_log_record record;
+    while (raw_log_next(reader, &record)) {
+        struct sample sample = { record.sensor_id, 0, record.timestamp_ns, { 0 } };
+
+        switch (record.type) {
+            case RAW_LOG_BME680_CALIB:
+                if (bme680_count == REPLAY_MAX_BME680) {
+                    errlog_record(ERR_RAW_LOG_REPLAY, 0, REPLAY_MAX_BME680);
+                    count = -1;
+
+                    goto out;
+                }
+
+                bme680[bme680_count].dev = bme680_open_replay(record.data, record.length);
+                if (!bme680[bme680_count].dev)
+                    break;
+
+                bme680[bme680_count++].sensor_id = record.sensor_id;
+            break;
+
+            case RAW_LOG_BME680: {
+                // the data is compensated with the sensor's latest calibration
+                struct bme680 *dev = NULL;
+                for (unsigned int i = 0; i < bme680_count; i++)
+                    if (bme680[i].sensor_id == record.sensor_id)
+                        dev = bme680[i].dev;
+
+                if (!dev || bme680_decode_raw(dev, record.data, record.length) == -1)
+                    break;
+
+                bme680_result(dev, &sample.values[0], &sample.values[1], &sample.values[2]);
+                sample.count = 3;
+
+                if (record.length == 16) {
+                    if (bme680_gas_result(dev, &sample.values[3], NULL) == -1)
+                        sample.values[3] = -1;
+
+                    sample.count = 4;
+                }
+            }
+            break;
+
+            case RAW_LOG_DHT22:
+                if (dht22_decode_raw(record.data, record.length, &sample.values[0], &sample.values[1], NULL) == 0)
+                    sample.count = 2;
+            break;
+
+            case RAW_LOG_Z19C: {
+                unsigned short co2;
+                if (z19c_decode_raw(record.data, record.length, &co2) == 0) {
+                    sample.values[0] = co2;
+                    sample.count = 1;
+                }
+            }
+            break;
+        }
+
+        if (sample.count) {
+            callback(&sample, arg);
+            count++;
+        }
+    }
+
+out:
+    for (unsigned int i = 0; i < bme680_count; i++)
+        bme680_close(bme680[i].dev);
+
+    return count;
+}
@@ -0,0 +1,66 @@
+#ifndef SENSORS_RAW_LOG_H
+#define SENSORS_RAW_LOG_H
+
+#include <stddef.h>
+
+#include "sample_bus.h"
+
+
+// The largest payload of a record
+#define RAW_LOG_MAX_PAYLOAD 128
+
+// What a record holds
+enum raw_log_type {
+    // the 42 calibration bytes of a BME680 (0x8A-0xA0, 0xE1-0xEE, 0x00-0x04), once per sensor and file
+    RAW_LOG_BME680_CALIB = 1,
+    // the burst read from 0x1D, 10 bytes, or with the heater on 15 with the gas ADC followed by
+    // the heater step of the measurement
+    RAW_LOG_BME680,
+    // the 40 high pulse widths of a DHT22 transmission in µs, as little-endian 16 bit words
+    RAW_LOG_DHT22,
+    // the 9 byte response frame of an MH-Z19C
+    RAW_LOG_Z19C
+};
+
+// A record of a mapped log, data points into the mapping
+struct raw_log_record {
+    enum raw_log_type type;
+    unsigned int sensor_id;
+
+    // CLOCK_MONOTONIC in ns, when the raw data was received
+    unsigned long long timestamp_ns;
+
+    const void *data;
+    unsigned int length;
+};
+
+// A log being written
+struct raw_log;
+
+// A log mapped for reading
+struct raw_log_reader {
+    const unsigned char *mem;
+    size_t length;
+    size_t offset;
+};
+
+// Create a new log at path, replacing an existing file
+struct raw_log *raw_log_create(const char *path);
+// Append a record with a single write, so drivers in different threads can share a log
+int raw_log_append(struct raw_log *log, enum raw_log_type type, unsigned int sensor_id,
+    unsigned long long timestamp_ns, const void *data, unsigned int length);
+int raw_log_close(struct raw_log *log);
+
+// Map a log read-only and iterate its records without copying them
+int raw_log_map(struct raw_log_reader *reader, const char *path);
+// Get the next record, returns 1 if there was one and 0 at the end (or at a record cut short by a crash)
+int raw_log_next(struct raw_log_reader *reader, struct raw_log_record *record);
+void raw_log_unmap(struct raw_log_reader *reader);
+
+// Decode every record of a mapped log with the drivers' decoding and compensation from the start,
+// calls callback with every sample decoded; returns the number of samples or -1
+int raw_log_replay(struct raw_log_reader *reader,
+    void (*callback)(const struct sample *sample, void *arg), void *arg);
+
+
+#endif
@@ -0,0 +1,160 @@
+#include "sample_bus.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+
+// A slot is a seqlock: seq is 2 * position + 1 while the sample at position is written
+// and 2 * position + 2 once it is complete
+struct sample_slot {
+    atomic_ullong seq;
+    struct sample sample;
+};
+
+struct sample_bus {
+    // the position of the next sample to publish
+    atomic_ullong head;
+    unsigned long long mask;
+
+    struct sample_slot slots[];
+};
+
+
+static unsigned long long slot_count(unsigned int size) {
+    unsigned long long slots = 1;
+    while (slots < size)
+        slots <<= 1;
+
+    return slots;
+}
+
+size_t sample_bus_footprint(unsigned int size) {
+    return sizeof(struct sample_bus) + slot_count(size) * sizeof(struct sample_slot);
+}
+
+struct sample_bus *sample_bus_init(void *mem, unsigned int size) {
+    struct sample_bus *bus = mem;
+    unsigned long long slots = slot_count(size);
+
+    atomic_init(&bus->head, 0);
+    bus->mask = slots - 1;
+
+    for (unsigned long long i = 0; i < slots; i++)
+        atomic_init(&bus->slots[i].seq, 0);
+
+    return bus;
+}
+
+struct sample_bus *sample_bus_create(unsigned int size) {
+    void *mem = malloc(sample_bus_footprint(size));
+    if (!mem)
+        return NULL;
+
+    return sample_bus_init(mem, size);
+}
+
+void sample_bus_destroy(struct sample_bus *bus) {
+    free(bus);
+}
+
+int sample_bus_publish(struct sample_bus *bus, const struct sample *sample) {
+    // claim a position, producers never wait for the readers
+    unsigned long long pos = atomic_fetch_add_explicit(&bus->head, 1, memory_order_relaxed);
+    struct sample_slot *slot = &bus->slots[pos & bus->mask];
+    const unsigned long long writing = 2 * pos + 1;
+
+    // take the slot over from a sample of an earlier lap; if a producer a lap ahead got to it while
+    // this one was preempted, the newer sample stays, and a producer of an earlier lap still writing
+    // it is waited for so the two copies do not interleave
+    unsigned long long seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    for (;;) {
+        if (seq >= writing)
+            return 0;
+
+        if (seq & 1)
+            seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+        else if (atomic_compare_exchange_weak_explicit(&slot->seq, &seq, writing,
+                                                       memory_order_acquire, memory_order_relaxed))
+            break;
+    }
+
+    atomic_thread_fence(memory_order_release);
+
+    slot->sample = *sample;
+
+    // the odd seq keeps every other producer off the slot, so it can not have changed
+    atomic_store_explicit(&slot->seq, writing + 1, memory_order_release);
+
+    return 1;
+}
+
+void sample_reader_init(struct sample_reader *reader, struct sample_bus *bus, int oldest) {
+    unsigned long long head = atomic_load_explicit(&bus->head, memory_order_acquire);
+
+    reader->bus    = bus;
+    reader->lost   = 0;
+    reader->cursor = head;
+
+    if (oldest)
+        reader->cursor = head > bus->mask ? head - bus->mask - 1 : 0;
+}
+
+int sample_reader_next(struct sample_reader *reader, struct sample *sample) {
+    struct sample_bus *bus = reader->bus;
+
+    for (;;) {
+        struct sample_slot *slot = &bus->slots[reader->cursor & bus->mask];
+        const unsigned long long want = 2 * reader->cursor + 2;
+
+        unsigned long long seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+        // not published yet or still being written
+        if (seq < want)
+            return 0;
+
+        if (seq == want) {
+            *sample = slot->sample;
+
+            // the sample is valid if it was not overwritten while copying it
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == want) {
+                reader->cursor++;
+                return 1;
+            }
+        }
+
+        // the ring wrapped past this reader, continue at the oldest sample still in it
+        unsigned long long head = atomic_load_explicit(&bus->head, memory_order_acquire);
+        unsigned long long oldest = head - bus->mask - 1;
+
+        reader->lost  += oldest - reader->cursor;
+        reader->cursor = oldest;
+    }
+}
+
+int sample_bus_latest(const struct sample_bus *bus, unsigned int sensor_id, struct sample *sample) {
+    // the slots are only read, so the bus may be mapped read-only
+    struct sample_bus *ring = (struct sample_bus *)bus;
+
+    unsigned long long head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    unsigned long long oldest = head > ring->mask ? head - ring->mask - 1 : 0;
+
+    // walk back from the newest sample, skipping the ones overwritten or still being written
+    for (unsigned long long pos = head; pos-- > oldest; ) {
+        const struct sample_slot *slot = &ring->slots[pos & ring->mask];
+        const unsigned long long want = 2 * pos + 2;
+
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != want ||
+            slot->sample.sensor_id != sensor_id)
+            continue;
+
+        *sample = slot->sample;
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == want &&
+            sample->sensor_id == sensor_id)
+            return 1;
+    }
+
+    return 0;
+}
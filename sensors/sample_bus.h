@@ -0,0 +1,53 @@
+#ifndef SENSORS_SAMPLE_BUS_H
+#define SENSORS_SAMPLE_BUS_H
+
+#include <stddef.h>
+
+#define SAMPLE_MAX_VALUES 4
+
+// One published reading, values are in the order of the driver's read function
+struct sample {
+    unsigned int sensor_id;
+    unsigned int count;
+
+    // CLOCK_MONOTONIC in ns
+    unsigned long long timestamp_ns;
+
+    float values[SAMPLE_MAX_VALUES];
+};
+
+struct sample_bus;
+
+// A consumer's position in a bus, every reader sees every sample unless it falls behind by a full ring
+struct sample_reader {
+    struct sample_bus *bus;
+    unsigned long long cursor;
+
+    // the samples overwritten before this reader got to them
+    unsigned long lost;
+};
+
+// Create a ring of size samples, size is rounded up to a power of two
+struct sample_bus *sample_bus_create(unsigned int size);
+void sample_bus_destroy(struct sample_bus *bus);
+
+// Place a bus in memory the caller owns (e.g. shared memory), which must be sample_bus_footprint(size) bytes;
+// the bus holds no pointers, so it works at any address in any process
+size_t sample_bus_footprint(unsigned int size);
+struct sample_bus *sample_bus_init(void *mem, unsigned int size);
+
+// Add a sample without locking, the oldest sample is overwritten once the ring is full; safe from several threads,
+// returns 0 if the sample was dropped because producers a full ring ahead took its slot while it was preempted
+int sample_bus_publish(struct sample_bus *bus, const struct sample *sample);
+
+// Start a reader at the oldest sample still in the ring (oldest != 0) or at the next published one
+void sample_reader_init(struct sample_reader *reader, struct sample_bus *bus, int oldest);
+
+// Get the next sample of a reader, returns 1 if there was one and 0 if the reader caught up
+int sample_reader_next(struct sample_reader *reader, struct sample *sample);
+
+// Get the newest sample of a sensor still in the ring without a reader, returns 1 if there was one
+int sample_bus_latest(const struct sample_bus *bus, unsigned int sensor_id, struct sample *sample);
+
+
+#endif
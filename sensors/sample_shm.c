@@ -0,0 +1,136 @@
+#include "sample_shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../interfaces/errlog.h"
+
+
+#define SHM_MAGIC   0x53504D52  // "RMPS"
+#define SHM_VERSION 2
+
+// The start of the shared memory object, the bus follows at offsetof(struct shm_header, bus)
+struct shm_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t history;
+
+    // set once the bus is initialized
+    atomic_uint ready;
+
+    _Alignas(64) unsigned char bus[];
+};
+
+
+int sample_shm_create(struct sample_shm *shm, const char *name, unsigned int history) {
+    size_t length = sizeof(struct shm_header) + sample_bus_footprint(history);
+
+    // start over instead of reusing a bus whose head may be anywhere
+    shm_unlink(name);
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd == -1) {
+        errlog_record_detail(ERR_SHM_CREATE, errno, 0, name);
+
+        return -1;
+    }
+
+    if (ftruncate(fd, length) == -1) {
+        errlog_record_detail(ERR_SHM_SIZE, errno, 0, name);
+
+        goto unlink;
+    }
+
+    void *mem = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED) {
+        errlog_record_detail(ERR_SHM_MAP, errno, 0, name);
+
+        goto unlink;
+    }
+
+    close(fd);
+
+    struct shm_header *header = mem;
+    header->magic   = SHM_MAGIC;
+    header->version = SHM_VERSION;
+    header->history = history;
+
+    shm->mem    = mem;
+    shm->length = length;
+    shm->bus    = sample_bus_init(header->bus, history);
+
+    atomic_store_explicit(&header->ready, 1, memory_order_release);
+
+    return 0;
+
+unlink:
+    close(fd);
+    shm_unlink(name);
+
+    return -1;
+}
+
+int sample_shm_open(struct sample_shm *shm, const char *name) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1) {
+        errlog_record_detail(ERR_SHM_OPEN, errno, 0, name);
+
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(struct shm_header)) {
+        errlog_record_detail(ERR_SHM_EMPTY, 0, 0, name);
+        close(fd);
+
+        return -1;
+    }
+
+    void *mem = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mem == MAP_FAILED) {
+        errlog_record_detail(ERR_SHM_MAP, errno, 0, name);
+
+        return -1;
+    }
+
+    struct shm_header *header = mem;
+    if (!atomic_load_explicit(&header->ready, memory_order_acquire) ||
+        header->magic != SHM_MAGIC || header->version != SHM_VERSION ||
+        sizeof(*header) + sample_bus_footprint(header->history) > (size_t)st.st_size) {
+        errlog_record_detail(ERR_SHM_FORMAT, 0, 0, name);
+        munmap(mem, st.st_size);
+
+        return -1;
+    }
+
+    shm->mem    = mem;
+    shm->length = st.st_size;
+    shm->bus    = (struct sample_bus *)header->bus;
+
+    return 0;
+}
+
+void sample_shm_close(struct sample_shm *shm) {
+    munmap(shm->mem, shm->length);
+
+    shm->mem = NULL;
+    shm->bus = NULL;
+}
+
+int sample_shm_unlink(const char *name) {
+    if (shm_unlink(name) == -1) {
+        errlog_record_detail(ERR_SHM_UNLINK, errno, 0, name);
+
+        return -1;
+    }
+
+    return 0;
+}
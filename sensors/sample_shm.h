@@ -0,0 +1,44 @@
+#ifndef SENSORS_SAMPLE_SHM_H
+#define SENSORS_SAMPLE_SHM_H
+
+#include <stddef.h>
+
+#include "sample_bus.h"
+
+
+// The shared memory object sensord publishes to
+#define SAMPLE_SHM_NAME     "/raspberry-periphery"
+// The samples kept by sensord, for all sensors together
+#define SAMPLE_SHM_HISTORY  1024
+
+// The sensor ids sensord publishes the drivers' samples as
+enum sample_shm_sensor {
+    // temperature (°C), pressure (hPa), humidity (%), and gas resistance (Ω) with the heater on
+    SAMPLE_SHM_BME680,
+    // temperature (°C), humidity (%)
+    SAMPLE_SHM_DHT22,
+    // CO₂ (ppm)
+    SAMPLE_SHM_Z19C
+};
+
+// A sample bus mapped from shared memory
+struct sample_shm {
+    void *mem;
+    size_t length;
+
+    struct sample_bus *bus;
+};
+
+// Create the shared memory object name with a bus of history samples and map it writable,
+// replaces an object left behind by an earlier publisher
+int sample_shm_create(struct sample_shm *shm, const char *name, unsigned int history);
+// Map an existing shared memory object read-only, then read shm->bus with sample_bus_latest
+// or a sample_reader, both of which make no system calls
+int sample_shm_open(struct sample_shm *shm, const char *name);
+void sample_shm_close(struct sample_shm *shm);
+
+// Remove the shared memory object, mapped buses stay valid until they are closed
+int sample_shm_unlink(const char *name);
+
+
+#endif
@@ -0,0 +1,405 @@
+#include "scheduler.h"
+#include "sensors.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "../interfaces/errlog.h"
+
+
+#define SCHEDULER_MAX_SENSORS   64
+
+// what an epoll event of a sensor stands for, stored in the low bits of its data
+enum {
+    EVENT_PERIOD,
+    EVENT_DEADLINE,
+    EVENT_FD
+};
+
+struct sched_sensor {
+    const struct sensor_ops *ops;
+    void *dev;
+
+    sensor_callback callback;
+    void *arg;
+
+    // the periodic timer starting the reads and the one-shot timer of the read's deadline
+    int period_fd;
+    int deadline_fd;
+    // the driver's file descriptor in the epoll set, -1 for none
+    int watched_fd;
+
+    unsigned long long period_ns;
+    // the scheduled time of the next period and of the pending read
+    unsigned long long next;
+    unsigned long long scheduled;
+    int pending;
+
+    struct scheduler_stats stats;
+};
+
+struct scheduler {
+    int epoll;
+    // set by scheduler_stop, which may be called from a signal handler
+    volatile sig_atomic_t stop;
+
+    unsigned int count;
+    struct sched_sensor sensors[SCHEDULER_MAX_SENSORS];
+};
+
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int watch(struct scheduler *sched, int fd, int id, int event) {
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = (uint64_t)id << 2 | event;
+
+    int ret = epoll_ctl(sched->epoll, EPOLL_CTL_ADD, fd, &ev);
+    if (ret == -1)
+        errlog_record(ERR_SCHED_WATCH, errno, fd);
+
+    return ret;
+}
+
+// keeps an fd that is already in the epoll set there with one call; closing an fd removes it
+// from the set, so if the driver closed and reopened it under the same number it is added again
+static int rewatch(struct scheduler *sched, int fd, int id, int event) {
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = (uint64_t)id << 2 | event;
+
+    if (epoll_ctl(sched->epoll, EPOLL_CTL_MOD, fd, &ev) == 0)
+        return 0;
+
+    if (errno != ENOENT) {
+        errlog_record(ERR_SCHED_WATCH, errno, fd);
+        return -1;
+    }
+
+    return watch(sched, fd, id, event);
+}
+
+static void set_timer(int fd, unsigned long long at_ns, int flags, unsigned long long interval_ns) {
+    struct itimerspec its;
+    its.it_value.tv_sec     = at_ns / 1000000000;
+    its.it_value.tv_nsec    = at_ns % 1000000000;
+    its.it_interval.tv_sec  = interval_ns / 1000000000;
+    its.it_interval.tv_nsec = interval_ns % 1000000000;
+
+    timerfd_settime(fd, flags, &its, NULL);
+}
+
+// follows the driver's file descriptor and deadline while a read is pending
+static void update_wait(struct scheduler *sched, int id) {
+    struct sched_sensor *s = &sched->sensors[id];
+
+    // an fd the driver no longer waits on leaves the set, the one of a read in progress stays in it
+    int fd = s->pending ? s->ops->fd(s->dev) : -1;
+    if (s->watched_fd != -1 && s->watched_fd != fd) {
+        epoll_ctl(sched->epoll, EPOLL_CTL_DEL, s->watched_fd, NULL);
+        s->watched_fd = -1;
+    }
+
+    if (fd != -1) {
+        int ret = fd == s->watched_fd ? rewatch(sched, fd, id, EVENT_FD) : watch(sched, fd, id, EVENT_FD);
+        s->watched_fd = ret == -1 ? -1 : fd;
+    }
+
+    // a deadline in the past expires right away, 0 disarms the timer
+    if (s->pending)
+        set_timer(s->deadline_fd, s->ops->deadline(s->dev) | 1, TFD_TIMER_ABSTIME, 0);
+    else
+        set_timer(s->deadline_fd, 0, 0, 0);
+}
+
+static void finish(struct scheduler *sched, int id, int rc) {
+    struct sched_sensor *s = &sched->sensors[id];
+    struct scheduler_stats *st = &s->stats;
+
+    s->pending = 0;
+    update_wait(sched, id);
+
+    unsigned long long latency = (now_ns() - s->scheduled) / 1000;
+
+    if (rc == 0)
+        st->reads++;
+    else
+        st->failures++;
+
+    st->latency_last_us = latency;
+    st->latency_sum_us += latency;
+    if (latency > st->latency_max_us)
+        st->latency_max_us = latency;
+    if (latency < st->latency_min_us || st->reads + st->failures == 1)
+        st->latency_min_us = latency;
+
+    if (s->callback)
+        s->callback(s->dev, rc, s->arg);
+}
+
+static void step(struct scheduler *sched, int id) {
+    struct sched_sensor *s = &sched->sensors[id];
+    if (!s->pending)
+        return;
+
+    int rc = s->ops->step(s->dev);
+    if (rc == SENSOR_PENDING)
+        update_wait(sched, id);
+    else
+        finish(sched, id, rc);
+}
+
+static void period(struct scheduler *sched, int id) {
+    struct sched_sensor *s = &sched->sensors[id];
+
+    uint64_t expirations;
+    if (read(s->period_fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return;
+
+    // only the latest of several expired periods is read
+    unsigned long long scheduled = s->next + (expirations - 1) * s->period_ns;
+    s->next += expirations * s->period_ns;
+    s->stats.misses += expirations - 1;
+
+    if (s->pending) {
+        s->stats.misses++;
+        return;
+    }
+
+    unsigned long long jitter = (now_ns() - scheduled) / 1000;
+    if (jitter > s->stats.start_jitter_max_us)
+        s->stats.start_jitter_max_us = jitter;
+
+    s->scheduled = scheduled;
+    s->pending = 1;
+
+    int rc = s->ops->start(s->dev);
+    if (rc == SENSOR_PENDING)
+        update_wait(sched, id);
+    else
+        finish(sched, id, rc);
+}
+
+
+struct scheduler *scheduler_create(void) {
+    struct scheduler *sched = calloc(1, sizeof(*sched));
+    if (!sched)
+        return NULL;
+
+    sched->epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (sched->epoll == -1) {
+        errlog_record(ERR_SCHED_CREATE, errno, 0);
+        free(sched);
+
+        return NULL;
+    }
+
+    return sched;
+}
+
+void scheduler_destroy(struct scheduler *sched) {
+    for (unsigned int i = 0; i < sched->count; i++) {
+        close(sched->sensors[i].period_fd);
+        close(sched->sensors[i].deadline_fd);
+    }
+
+    close(sched->epoll);
+    free(sched);
+}
+
+int scheduler_add(struct scheduler *sched, const struct sensor_ops *ops, void *dev,
+    unsigned int period_ms, sensor_callback callback, void *arg) {
+    if (sched->count == SCHEDULER_MAX_SENSORS || period_ms == 0) {
+        errlog_record(ERR_SCHED_ADD, 0, period_ms);
+        return -1;
+    }
+
+    int id = sched->count;
+    struct sched_sensor *s = &sched->sensors[id];
+
+    memset(s, 0, sizeof(*s));
+    s->ops        = ops;
+    s->dev        = dev;
+    s->callback   = callback;
+    s->arg        = arg;
+    s->watched_fd = -1;
+    s->period_ns  = period_ms * 1000000ULL;
+
+    s->period_fd   = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    s->deadline_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (s->period_fd == -1 || s->deadline_fd == -1) {
+        errlog_record(ERR_SCHED_TIMER, errno, 0);
+
+        goto close;
+    }
+
+    if (watch(sched, s->period_fd, id, EVENT_PERIOD) == -1 ||
+        watch(sched, s->deadline_fd, id, EVENT_DEADLINE) == -1)
+        goto close;
+
+    // the first period starts now
+    s->next = now_ns();
+    set_timer(s->period_fd, s->next, TFD_TIMER_ABSTIME, s->period_ns);
+
+    sched->count++;
+
+    return id;
+
+close:
+    if (s->period_fd != -1)
+        close(s->period_fd);
+    if (s->deadline_fd != -1)
+        close(s->deadline_fd);
+
+    return -1;
+}
+
+int scheduler_run(struct scheduler *sched, int timeout) {
+    unsigned long long end = now_ns() + (timeout < 0 ? 0 : timeout * 1000000ULL);
+
+    sched->stop = 0;
+    while (!sched->stop) {
+        int wait = -1;
+        if (timeout >= 0) {
+            long long left = end - now_ns();
+            if (left <= 0)
+                break;
+
+            wait = (left + 999999) / 1000000;
+        }
+
+        struct epoll_event events[16];
+        int n = epoll_wait(sched->epoll, events, 16, wait);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+
+            errlog_record(ERR_SCHED_WAIT, errno, 0);
+
+            return -1;
+        }
+
+        for (int i = 0; i < n; i++) {
+            int id = events[i].data.u64 >> 2;
+
+            switch (events[i].data.u64 & 3) {
+                case EVENT_PERIOD:
+                    period(sched, id);
+                break;
+
+                case EVENT_DEADLINE: {
+                    uint64_t expirations;
+                    read(sched->sensors[id].deadline_fd, &expirations, sizeof(expirations));
+                    step(sched, id);
+                }
+                break;
+
+                case EVENT_FD:
+                    step(sched, id);
+                break;
+            }
+        }
+    }
+
+    return 0;
+}
+
+void scheduler_stop(struct scheduler *sched) {
+    sched->stop = 1;
+}
+
+int scheduler_get_stats(const struct scheduler *sched, int id, struct scheduler_stats *stats) {
+    if (id < 0 || (unsigned int)id >= sched->count)
+        return -1;
+
+    *stats = sched->sensors[id].stats;
+
+    return 0;
+}
+
+
+static int bme680_ops_start(void *dev) {
+    return bme680_start(dev);
+}
+
+static int bme680_ops_step(void *dev) {
+    return bme680_step(dev);
+}
+
+static int bme680_ops_fd(const void *dev) {
+    (void)dev;
+    return -1;
+}
+
+static unsigned long long bme680_ops_deadline(const void *dev) {
+    return bme680_deadline(dev);
+}
+
+const struct sensor_ops bme680_ops = {
+    .start    = bme680_ops_start,
+    .step     = bme680_ops_step,
+    .fd       = bme680_ops_fd,
+    .deadline = bme680_ops_deadline,
+};
+
+
+static int dht22_ops_start(void *dev) {
+    return dht22_start(dev);
+}
+
+static int dht22_ops_step(void *dev) {
+    return dht22_step(dev);
+}
+
+static int dht22_ops_fd(const void *dev) {
+    return dht22_fd(dev);
+}
+
+static unsigned long long dht22_ops_deadline(const void *dev) {
+    return dht22_deadline(dev);
+}
+
+const struct sensor_ops dht22_ops = {
+    .start    = dht22_ops_start,
+    .step     = dht22_ops_step,
+    .fd       = dht22_ops_fd,
+    .deadline = dht22_ops_deadline,
+};
+
+
+static int z19c_ops_start(void *dev) {
+    return z19c_start(dev, -1);
+}
+
+static int z19c_ops_step(void *dev) {
+    return z19c_step(dev);
+}
+
+static int z19c_ops_fd(const void *dev) {
+    return z19c_fd(dev);
+}
+
+static unsigned long long z19c_ops_deadline(const void *dev) {
+    return z19c_deadline(dev);
+}
+
+const struct sensor_ops z19c_ops = {
+    .start    = z19c_ops_start,
+    .step     = z19c_ops_step,
+    .fd       = z19c_ops_fd,
+    .deadline = z19c_ops_deadline,
+};
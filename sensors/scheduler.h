@@ -0,0 +1,58 @@
+#ifndef SENSORS_SCHEDULER_H
+#define SENSORS_SCHEDULER_H
+
+
+// The asynchronous read functions of a driver, dev is the driver's session
+struct sensor_ops {
+    int (*start)(void *dev);
+    int (*step)(void *dev);
+
+    // the file descriptor to wait for while a read is pending, -1 for none
+    int (*fd)(const void *dev);
+    // when step has to be called at the latest, CLOCK_MONOTONIC in ns
+    unsigned long long (*deadline)(const void *dev);
+};
+
+// The drivers in sensors.h, for sessions from bme680_open, dht22_open, and z19c_open
+extern const struct sensor_ops bme680_ops;
+extern const struct sensor_ops dht22_ops;
+extern const struct sensor_ops z19c_ops;
+
+// Called after every read with its result, get the values with the driver's *_result function
+typedef void (*sensor_callback)(void *dev, int rc, void *arg);
+
+// Timing of one scheduled sensor
+struct scheduler_stats {
+    unsigned long reads;
+    unsigned long failures;
+    // periods skipped because the previous read was still pending or the loop was late
+    unsigned long misses;
+
+    // from the scheduled start to the end of a read, in µs
+    unsigned long long latency_last_us;
+    unsigned long long latency_min_us;
+    unsigned long long latency_max_us;
+    unsigned long long latency_sum_us;
+
+    // the largest delay of a start after its scheduled time, in µs
+    unsigned long long start_jitter_max_us;
+};
+
+struct scheduler;
+
+struct scheduler *scheduler_create(void);
+void scheduler_destroy(struct scheduler *sched);
+
+// Read a sensor every period_ms, the first read starts right away; returns the sensor's id
+int scheduler_add(struct scheduler *sched, const struct sensor_ops *ops, void *dev,
+    unsigned int period_ms, sensor_callback callback, void *arg);
+
+// Run the loop until scheduler_stop is called (a signal handler may call it) or timeout ms passed
+// (negative for no timeout)
+int scheduler_run(struct scheduler *sched, int timeout);
+void scheduler_stop(struct scheduler *sched);
+
+int scheduler_get_stats(const struct scheduler *sched, int id, struct scheduler_stats *stats);
+
+
+#endif
@@ -0,0 +1,133 @@
+// The sensor daemon: owns the I²C bus, the DHT22 pin, and the serial port, reads all sensors
+// on a schedule, and publishes the samples to shared memory for other processes (sample_shm.h)
+//
+//     sensord [-n shm-name] [-s serial-port] [-l raw-log]
+
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "raw_log.h"
+#include "sample_shm.h"
+#include "scheduler.h"
+#include "sensors.h"
+#include "../interfaces/errlog.h"
+
+
+#define BME680_PERIOD_MS    1000
+// the DHT22 needs 2 s between reads
+#define DHT22_PERIOD_MS     2500
+#define Z19C_PERIOD_MS      1000
+// how often the drivers' errors get printed
+#define ERRLOG_PERIOD_MS    500
+
+static struct scheduler *sched;
+
+static void stop(int sig) {
+    (void)sig;
+    scheduler_stop(sched);
+}
+
+int main(int argc, char *argv[]) {
+    const char *name = SAMPLE_SHM_NAME;
+    const char *path = "/dev/ttyS0";
+    const char *log_path = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:l:")) != -1) {
+        switch (opt) {
+            case 'n': name = optarg; break;
+            case 's': path = optarg; break;
+            case 'l': log_path = optarg; break;
+
+            default:
+                fprintf(stderr, "Usage: %s [-n shm-name] [-s serial-port] [-l raw-log]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    // the drivers only record their errors, print them off the read path
+    errlog_start_logger(stderr, ERRLOG_PERIOD_MS);
+
+    struct sample_shm shm;
+    if (sample_shm_create(&shm, name, SAMPLE_SHM_HISTORY) == -1)
+        goto stop;
+
+    // keep the raw data of every read as well, to reprocess it later
+    struct raw_log *log = NULL;
+    if (log_path && !(log = raw_log_create(log_path)))
+        goto unlink;
+
+    sched = scheduler_create();
+    if (!sched)
+        goto unlink;
+
+    // publish whatever sensors are attached
+    struct bme680 *bme680 = bme680_open(1, BME680_ADDR_HIGH);
+    if (bme680) {
+        bme680_set_bus(bme680, shm.bus, SAMPLE_SHM_BME680);
+        if (log)
+            bme680_set_log(bme680, log, SAMPLE_SHM_BME680);
+
+        scheduler_add(sched, &bme680_ops, bme680, BME680_PERIOD_MS, NULL, NULL);
+    }
+
+    struct dht22 *dht22 = dht22_open(DHT22_MODE_EDGES);
+    if (dht22) {
+        dht22_set_bus(dht22, shm.bus, SAMPLE_SHM_DHT22);
+        if (log)
+            dht22_set_log(dht22, log, SAMPLE_SHM_DHT22);
+
+        scheduler_add(sched, &dht22_ops, dht22, DHT22_PERIOD_MS, NULL, NULL);
+    }
+
+    struct z19c *z19c = z19c_open(path);
+    if (z19c) {
+        z19c_set_bus(z19c, shm.bus, SAMPLE_SHM_Z19C);
+        if (log)
+            z19c_set_log(z19c, log, SAMPLE_SHM_Z19C);
+
+        scheduler_add(sched, &z19c_ops, z19c, Z19C_PERIOD_MS, NULL, NULL);
+    }
+
+    // without SA_RESTART, so the signals interrupt the scheduler's epoll_wait
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop;
+
+    sigaction(SIGINT,  &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    int rc = scheduler_run(sched, -1);
+
+    scheduler_destroy(sched);
+
+    if (bme680)
+        bme680_close(bme680);
+    if (dht22)
+        dht22_close(dht22);
+    if (z19c)
+        z19c_close(z19c);
+    if (log)
+        raw_log_close(log);
+
+    sample_shm_close(&shm);
+    sample_shm_unlink(name);
+
+    errlog_stop_logger();
+
+    return rc == -1;
+
+unlink:
+    if (log)
+        raw_log_close(log);
+
+    sample_shm_close(&shm);
+    sample_shm_unlink(name);
+
+stop:
+    errlog_stop_logger();
+
+    return 1;
+}
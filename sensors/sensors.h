@@ -1,8 +1,180 @@
 #ifndef SENSORS_H
 #define SENSORS_H
 
+// The I²C addresses of the BME680, selected by its SDO pin
+#define BME680_ADDR_LOW     0x76
+#define BME680_ADDR_HIGH    0x77
+
+// How dht22_read captures the bit stream
+enum dht22_mode {
+    // busy-poll the pin level and measure the pulses in user space
+    DHT22_MODE_POLL,
+    // collect kernel-timestamped edges and decode them afterwards
+    DHT22_MODE_EDGES,
+    // busy-poll like DHT22_MODE_POLL, but as SCHED_FIFO, pinned to one core, with locked memory
+    // (the first read locks the process's memory and it stays locked)
+    DHT22_MODE_REALTIME,
+    // sample the pin level at a fixed rate from a pinned thread and run-length decode the samples
+    DHT22_MODE_SAMPLED,
+
+    DHT22_MODE_COUNT
+};
+
+// 1 µs wide buckets of the pulse width deviation from the nominal 27 µs (0) or 70 µs (1),
+// the last bucket counts all larger deviations
+#define DHT22_JITTER_BUCKETS 16
+
+// statistics of dht22_read for one mode
+struct dht22_stats {
+    unsigned long reads;
+    unsigned long attempts;
+    unsigned long failures;
+
+    unsigned long jitter[DHT22_JITTER_BUCKETS];
+};
+
+// The oversampling of a BME680 measurement, more samples lower the noise and lengthen the conversion
+enum bme680_oversampling {
+    BME680_OS_SKIP,
+    BME680_OS_1X,
+    BME680_OS_2X,
+    BME680_OS_4X,
+    BME680_OS_8X,
+    BME680_OS_16X
+};
+
+// The coefficient of the BME680 IIR filter on temperature and pressure, higher is smoother but slower to follow
+enum bme680_filter {
+    BME680_FILTER_OFF,
+    BME680_FILTER_1,
+    BME680_FILTER_3,
+    BME680_FILTER_7,
+    BME680_FILTER_15,
+    BME680_FILTER_31,
+    BME680_FILTER_63,
+    BME680_FILTER_127
+};
+
+struct bme680_config {
+    enum bme680_oversampling temp_os, pres_os, hum_os;
+    enum bme680_filter filter;
+};
+
+// T x1, P x1, H x1, no filter: about 11 ms per measurement
+extern const struct bme680_config bme680_low_latency;
+// T x8, P x4, H x2, filter 3: about 33 ms per measurement, the default of bme680_open
+extern const struct bme680_config bme680_balanced;
+// T x16, P x16, H x16, filter 15: about 99 ms per measurement
+extern const struct bme680_config bme680_low_noise;
+
+// The heater set-points of the BME680 gas sensor
+#define BME680_HEATER_STEPS 10
+
+// A BME680 heater profile, each measurement heats to the next step and starts over after the last;
+// the BME680 takes one gas reading per forced-mode measurement (running a whole profile in one cycle
+// is the parallel mode of the BME688), so a profile of n steps takes n reads, one trigger each
+struct bme680_heater_profile {
+    unsigned int count;
+
+    // the target temperature in °C (up to 400) and how long to hold it in ms (up to 4032)
+    unsigned short temp[BME680_HEATER_STEPS];
+    unsigned short duration[BME680_HEATER_STEPS];
+};
+
+// returned by the *_start and *_step functions while a read is in progress
+#define SENSOR_PENDING 1
+
+struct bme680;
+struct dht22;
+struct z19c;
+struct sample_bus;
+struct raw_log;
+struct GPIO_edgeEvent;
+
 int read_bme680_data(float *temp, float *pres, float *hum);
 int read_dht22_data(float *temp, float *hum);
 int read_z19c_data(unsigned short *co2);
 
+// margin (may be NULL) is the confidence of the last decoded frame, from 0 (ambiguous bits) to 1
+int dht22_read(enum dht22_mode mode, float *temp, float *hum, float *margin);
+
+// asynchronous reads: dht22_start returns immediately, then call dht22_step when dht22_fd
+// (if not -1) is readable or when CLOCK_MONOTONIC reaches dht22_deadline (ns),
+// until it returns 0 (success) or -1 (failure)
+struct dht22 *dht22_open(enum dht22_mode mode);
+int dht22_start(struct dht22 *dev);
+int dht22_step(struct dht22 *dev);
+int dht22_fd(const struct dht22 *dev);
+unsigned long long dht22_deadline(const struct dht22 *dev);
+int dht22_result(const struct dht22 *dev, float *temp, float *hum, float *margin);
+int dht22_close(struct dht22 *dev);
+
+// publish every successful read of the session to bus as sensor_id (values temp, hum), NULL stops it
+void dht22_set_bus(struct dht22 *dev, struct sample_bus *bus, unsigned int sensor_id);
+
+// log the pulse widths of every captured transmission to log as sensor_id, NULL stops it
+void dht22_set_log(struct dht22 *dev, struct raw_log *log, unsigned int sensor_id);
+// decode a RAW_LOG_DHT22 record like a read, margin may be NULL
+int dht22_decode_raw(const void *raw, unsigned int length, float *temp, float *hum, float *margin);
+// decode the edges of a transmission from GPIO_readEdges like a DHT22_MODE_EDGES read, margin may be NULL
+int dht22_decode_edges(const struct GPIO_edgeEvent *events, unsigned int count, float *temp, float *hum, float *margin);
+
+void dht22_set_realtime_cpu(int cpu);
+void dht22_get_stats(enum dht22_mode mode, struct dht22_stats *stats);
+void dht22_reset_stats(void);
+
+struct bme680 *bme680_open(int bus, int addr);
+int bme680_read(struct bme680 *dev, float *temp, float *pres, float *hum);
+int bme680_configure(struct bme680 *dev, const struct bme680_config *config);
+// compensate count raw ADC samples (structure of arrays) with the session's calibration, four at a time
+// with SSE4.1 on x86-64, gives bit for bit the values bme680_read would have; pres_adc/pres and hum_adc/hum
+// may be NULL to skip them
+void bme680_compensate(const struct bme680 *dev, unsigned int count,
+    const unsigned int *temp_adc, const unsigned int *pres_adc, const unsigned short *hum_adc,
+    float *temp, float *pres, float *hum);
+int bme680_close(struct bme680 *dev);
+
+// asynchronous reads: bme680_start triggers a measurement, then call bme680_step when
+// CLOCK_MONOTONIC reaches bme680_deadline (ns), until it returns 0 (success) or -1 (failure)
+int bme680_start(struct bme680 *dev);
+int bme680_step(struct bme680 *dev);
+unsigned long long bme680_deadline(const struct bme680 *dev);
+int bme680_result(const struct bme680 *dev, float *temp, float *pres, float *hum);
+// log the calibration and the raw data of every measurement to log as sensor_id, NULL stops it
+int bme680_set_log(struct bme680 *dev, struct raw_log *log, unsigned int sensor_id);
+// a session without a sensor from a RAW_LOG_BME680_CALIB record, to decode RAW_LOG_BME680 records
+// with bme680_decode_raw and get the values with bme680_result and bme680_gas_result
+struct bme680 *bme680_open_replay(const void *calib, unsigned int length);
+int bme680_decode_raw(struct bme680 *dev, const void *raw, unsigned int length);
+
+// set the heater profile of the gas sensor, NULL turns it off (the default); the set-points follow
+// the last measured temperature like the vendor's compensation
+int bme680_set_heater(struct bme680 *dev, const struct bme680_heater_profile *profile);
+// step (may be NULL) is the profile step the gas resistance (Ω) was measured at
+int bme680_gas_result(const struct bme680 *dev, float *gas, unsigned int *step);
+// publish every successful read of the session to bus as sensor_id (values temp, pres, hum, and gas
+// with the heater on, -1 if the gas reading was invalid), NULL stops it
+void bme680_set_bus(struct bme680 *dev, struct sample_bus *bus, unsigned int sensor_id);
+
+// timeout is in ms, negative for the default of 1 s
+struct z19c *z19c_open(const char *path);
+int z19c_read(struct z19c *dev, unsigned short *co2, int timeout);
+int z19c_close(struct z19c *dev);
+
+// asynchronous reads: z19c_start sends the command, then call z19c_step when z19c_fd is readable
+// or when CLOCK_MONOTONIC reaches z19c_deadline (ns), until it returns 0 (success) or -1 (failure)
+int z19c_start(struct z19c *dev, int timeout);
+int z19c_step(struct z19c *dev);
+int z19c_fd(const struct z19c *dev);
+unsigned long long z19c_deadline(const struct z19c *dev);
+int z19c_result(const struct z19c *dev, unsigned short *co2);
+// publish every successful read of the session to bus as sensor_id (value co2), NULL stops it
+void z19c_set_bus(struct z19c *dev, struct sample_bus *bus, unsigned int sensor_id);
+// log every response frame to log as sensor_id, NULL stops it
+void z19c_set_log(struct z19c *dev, struct raw_log *log, unsigned int sensor_id);
+// check and decode a RAW_LOG_Z19C record
+int z19c_decode_raw(const void *raw, unsigned int length, unsigned short *co2);
+// set the serial port read_z19c_data opens, NULL restores /dev/ttyS0
+void z19c_set_path(const char *path);
+
 #endif
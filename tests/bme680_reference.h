@@ -0,0 +1,85 @@
+#ifndef TESTS_BME680_REFERENCE_H
+#define TESTS_BME680_REFERENCE_H
+
+#include "../sensors/bme680_sim.h"
+
+
+// The floating-point compensation of the vendor's BME68x API, an independent reference
+// for the driver's integer compensation
+
+static double ref_temperature(const struct bme680_sim_calib *c, unsigned int temp_adc, double *t_fine) {
+    double var1 = ((temp_adc / 16384.0) - (c->t1 / 1024.0)) * c->t2;
+    double var2 = ((temp_adc / 131072.0) - (c->t1 / 8192.0)) *
+                  ((temp_adc / 131072.0) - (c->t1 / 8192.0)) * (c->t3 * 16.0);
+
+    *t_fine = var1 + var2;
+
+    return *t_fine / 5120.0;
+}
+
+// in Pa
+static double ref_pressure(const struct bme680_sim_calib *c, unsigned int pres_adc, double t_fine) {
+    double var1 = (t_fine / 2.0) - 64000.0;
+    double var2 = var1 * var1 * (c->p6 / 131072.0);
+    var2 = var2 + (var1 * c->p5 * 2.0);
+    var2 = (var2 / 4.0) + (c->p4 * 65536.0);
+    var1 = (((c->p3 * var1 * var1) / 16384.0) + (c->p2 * var1)) / 524288.0;
+    var1 = (1.0 + (var1 / 32768.0)) * c->p1;
+
+    double pres = 1048576.0 - pres_adc;
+    pres = ((pres - (var2 / 4096.0)) * 6250.0) / var1;
+
+    var1 = (c->p9 * pres * pres) / 2147483648.0;
+    var2 = pres * (c->p8 / 32768.0);
+    double var3 = (pres / 256.0) * (pres / 256.0) * (pres / 256.0) * (c->p10 / 131072.0);
+
+    return pres + (var1 + var2 + var3 + (c->p7 * 128.0)) / 16.0;
+}
+
+// in %
+static double ref_humidity(const struct bme680_sim_calib *c, unsigned int hum_adc, double t_fine) {
+    double temp = t_fine / 5120.0;
+
+    double var1 = hum_adc - ((c->h1 * 16.0) + ((c->h3 / 2.0) * temp));
+    double var2 = var1 * ((c->h2 / 262144.0) *
+        (1.0 + ((c->h4 / 16384.0) * temp) + ((c->h5 / 1048576.0) * temp * temp)));
+    double var3 = c->h6 / 16384.0;
+    double var4 = c->h7 / 2097152.0;
+
+    double hum = var2 + ((var3 + (var4 * temp)) * var2 * var2);
+
+    return hum > 100 ? 100 : hum < 0 ? 0 : hum;
+}
+
+// the heater resistance set-point (res_heat_x) for a target and an ambient temperature in °C
+static double ref_res_heat(const struct bme680_sim_calib *c, unsigned int temp, int amb_temp) {
+    if (temp > 400)
+        temp = 400;
+
+    double var1 = (c->gh1 / 16.0) + 49.0;
+    double var2 = ((c->gh2 / 32768.0) * 0.0005) + 0.00235;
+    double var3 = c->gh3 / 1024.0;
+    double var4 = var1 * (1.0 + (var2 * temp));
+    double var5 = var4 + (var3 * amb_temp);
+
+    return 3.4 * ((var5 * (4.0 / (4.0 + c->res_heat_range)) * (1.0 / (1.0 + (c->res_heat_val * 0.002)))) - 25);
+}
+
+// in Ω, the range correction of the BME680 (the low gas variant of the BME68x API)
+static double ref_gas_resistance(const struct bme680_sim_calib *c, unsigned int gas_adc, unsigned int range) {
+    static const double k1[16] = {
+        0.0, 0.0, 0.0, 0.0, 0.0, -1.0, 0.0, -0.8, 0.0, 0.0, -0.2, -0.5, 0.0, -1.0, 0.0, 0.0
+    };
+    static const double k2[16] = {
+        0.0, 0.0, 0.0, 0.0, 0.1, 0.7, 0.0, -0.8, -0.1, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0
+    };
+
+    double var1 = 1340.0 + (5.0 * c->range_sw_err);
+    double var2 = var1 * (1.0 + k1[range] / 100.0);
+    double var3 = 1.0 + (k2[range] / 100.0);
+
+    return 1.0 / (var3 * 0.000000125 * (1u << range) * (((gas_adc - 512.0) / var2) + 1.0));
+}
+
+
+#endif
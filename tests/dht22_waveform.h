@@ -0,0 +1,44 @@
+#ifndef TESTS_DHT22_WAVEFORM_H
+#define TESTS_DHT22_WAVEFORM_H
+
+#include "../interfaces/gpio_sim.h"
+
+
+// The steps of a DHT22 transmission after the line is released: the release, the response,
+// 40 bits, and the line going idle
+#define DHT22_WAVEFORM_STEPS (3 + 2 * 40 + 2)
+
+// Script the transmission of a 5-byte frame, with the high pulse widths of a 0 and a 1 in µs
+static void dht22_waveform(struct GPIO_simStep steps[DHT22_WAVEFORM_STEPS], const unsigned char frame[5],
+    unsigned int zero_us, unsigned int one_us) {
+    unsigned int n = 0;
+
+    // the pull-up until the sensor responds, then its 80 µs low and high response
+    steps[n++] = (struct GPIO_simStep){ 30, GPIO_HIGH };
+    steps[n++] = (struct GPIO_simStep){ 80, GPIO_LOW };
+    steps[n++] = (struct GPIO_simStep){ 80, GPIO_HIGH };
+
+    for (int i = 0; i < 40; i++) {
+        int bit = frame[i / 8] >> (7 - i % 8) & 1;
+
+        steps[n++] = (struct GPIO_simStep){ 50, GPIO_LOW };
+        steps[n++] = (struct GPIO_simStep){ bit ? one_us : zero_us, GPIO_HIGH };
+    }
+
+    steps[n++] = (struct GPIO_simStep){ 50, GPIO_LOW };
+    steps[n++] = (struct GPIO_simStep){ 1, GPIO_HIGH };
+}
+
+// Make a valid frame of a temperature (0.1 °C) and a humidity (0.1 %)
+static void dht22_frame(unsigned char frame[5], int temp, unsigned int hum) {
+    unsigned int t = temp < 0 ? (unsigned int)-temp | 0x8000 : (unsigned int)temp;
+
+    frame[0] = hum >> 8;
+    frame[1] = hum & 0xFF;
+    frame[2] = t >> 8;
+    frame[3] = t & 0xFF;
+    frame[4] = frame[0] + frame[1] + frame[2] + frame[3];
+}
+
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef TESTS_TEST_H
+#define TESTS_TEST_H
+
+#include <math.h>
+#include <stdio.h>
+
+
+// The failed checks of the test binary, its exit status is whether there were any
+static int test_failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_NEAR(value, expected, tolerance) do { \
+        double v_ = (value), e_ = (expected); \
+        if (!(fabs(v_ - e_) <= (tolerance))) { \
+            fprintf(stderr, "%s:%d: check failed: %s is %g, expected %g ± %g\n", \
+                __FILE__, __LINE__, #value, v_, e_, (double)(tolerance)); \
+            test_failures++; \
+        } \
+    } while (0)
+
+// Run a test function and name it if it failed
+#define RUN(test) do { \
+        int before_ = test_failures; \
+        test(); \
+        fprintf(stderr, "%s %s\n", test_failures == before_ ? "ok  " : "FAIL", #test); \
+    } while (0)
+
+#define TEST_EXIT() (test_failures ? 1 : 0)
+
+
+#endif
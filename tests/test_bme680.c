@@ -0,0 +1,329 @@
+// The BME680 driver against an emulated sensor on the simulated I²C bus
+
+#include "test.h"
+
+#include <string.h>
+
+#include "bme680_reference.h"
+#include "../interfaces/errlog.h"
+#include "../interfaces/i2c_sim.h"
+#include "../sensors/bme680_sim.h"
+#include "../sensors/sensors.h"
+
+
+#define BUS     I2C_DEFAULT_BUS
+#define ADDR    BME680_ADDR_HIGH
+
+static const struct bme680_sim_calib *calib = &bme680_sim_default_calib;
+
+
+static void setup(void) {
+    i2c_set_transport(&i2c_sim_transport);
+    i2c_sim_reset();
+
+    bme680_sim_add(BUS, ADDR, NULL);
+}
+
+// the driver's integer compensation agrees with the vendor's floating-point one
+static void test_read_matches_reference(void) {
+    // below about 1060 hPa, above that the cube term of the vendor's integer compensation overflows
+    // int32 with this calibration (p10 = 30)
+    static const unsigned int adc[][3] = {
+        { 500000, 330000, 21000 },
+        { 450000, 300000, 25000 },
+        { 550000, 360000, 18000 },
+        { 520000, 345000, 30000 },
+    };
+
+    setup();
+
+    struct bme680 *dev = bme680_open(BUS, ADDR);
+    CHECK(dev != NULL);
+    if (!dev)
+        return;
+
+    for (unsigned int i = 0; i < sizeof(adc) / sizeof(adc[0]); i++) {
+        bme680_sim_set_adc(BUS, ADDR, adc[i][0], adc[i][1], adc[i][2]);
+
+        float temp, pres, hum;
+        CHECK(bme680_read(dev, &temp, &pres, &hum) == 0);
+
+        double t_fine;
+        CHECK_NEAR(temp, ref_temperature(calib, adc[i][0], &t_fine), 0.02);
+        CHECK_NEAR(pres * 100, ref_pressure(calib, adc[i][1], t_fine), 10);
+        CHECK_NEAR(hum, ref_humidity(calib, adc[i][2], t_fine), 0.1);
+    }
+
+    CHECK(bme680_close(dev) == 0);
+}
+
+// the one-shot read opens the default bus and address
+static void test_read_bme680_data(void) {
+    setup();
+
+    float temp, pres, hum;
+    CHECK(read_bme680_data(&temp, &pres, &hum) == 0);
+
+    double t_fine;
+    CHECK_NEAR(temp, ref_temperature(calib, 500000, &t_fine), 0.02);
+}
+
+// a session reads the calibration and writes the configuration once, then each read is the
+// trigger and one burst read, instead of the five transactions of a one-shot read
+static void test_transactions(void) {
+    setup();
+
+    struct bme680 *dev = bme680_open(BUS, ADDR);
+    CHECK(dev != NULL);
+    if (!dev)
+        return;
+
+    // config and ctrl_hum, then the three calibration blocks in one combined read
+    CHECK(i2c_sim_transactions() == 3);
+
+    // the trigger is 3 bytes, the burst read of 0x1D-0x26 is 3 and 10 of data
+    float temp, pres, hum;
+    for (int i = 0; i < 10; i++) {
+        unsigned long before = i2c_sim_transactions(), bytes = i2c_sim_bytes();
+
+        CHECK(bme680_read(dev, &temp, &pres, &hum) == 0);
+        CHECK(i2c_sim_transactions() - before == 2);
+        CHECK(i2c_sim_bytes() - bytes == 16);
+    }
+
+    bme680_close(dev);
+
+    unsigned long before = i2c_sim_transactions();
+    CHECK(read_bme680_data(&temp, &pres, &hum) == 0);
+    CHECK(i2c_sim_transactions() - before == 5);
+
+    // a combined read returns its number of segments like the Linux transport
+    int i2c = i2c_open_bus(BUS, ADDR);
+    unsigned char a[2], b[3];
+    const struct i2c_segment segments[] = { { 0x1D, a, sizeof(a) }, { 0x8A, b, sizeof(b) } };
+    CHECK(i2c_read_segments(i2c, segments, 2) == 2);
+    CHECK(i2c_read_segments(i2c, segments, I2C_MAX_SEGMENTS + 1) == -1);
+    CHECK(errlog_last(NULL) == ERR_I2C_SEGMENTS);
+    i2c_close(i2c);
+}
+
+// a measurement that never completes fails instead of returning the old data
+static void test_not_ready(void) {
+    setup();
+
+    struct bme680 *dev = bme680_open(BUS, ADDR);
+    CHECK(dev != NULL);
+    if (!dev)
+        return;
+
+    // still measuring
+    i2c_sim_registers(BUS, ADDR)[0x1D] = 0xA0;
+
+    float temp, pres, hum;
+    CHECK(bme680_read(dev, &temp, &pres, &hum) == -1);
+
+    bme680_close(dev);
+}
+
+// the heater set-points agree with the vendor's floating-point formula, and the durations are encoded
+// as a 6 bit value times 1, 4, 16, or 64 ms
+static void test_heater_setpoints(void) {
+    static const struct bme680_heater_profile profile = {
+        5, { 200, 250, 320, 400, 450 }, { 1, 63, 100, 150, 5000 }
+    };
+    // 100 ms is 25 * 4 ms (0x59), 150 ms is 37 * 4 ms (0x65), and anything from 4032 ms is the most (0xFF)
+    static const unsigned char gas_wait[] = { 0x01, 0x3F, 0x59, 0x65, 0xFF };
+
+    setup();
+
+    struct bme680 *dev = bme680_open(BUS, ADDR);
+    CHECK(dev != NULL);
+    if (!dev)
+        return;
+
+    // the ambient term of the vendor's integer formula, (amb_temp * gh3 / 1000) * 256, stays below
+    // one step of the set-point next to the target term, so it matches the floating-point one at
+    // 0 °C, rounded instead of truncated; the floating-point one adds about 1.5 steps at 25 °C
+    const unsigned char *regs = i2c_sim_registers(BUS, ADDR);
+    CHECK(bme680_set_heater(dev, &profile) == 0);
+
+    for (unsigned int i = 0; i < profile.count; i++) {
+        CHECK_NEAR(regs[0x5A + i], ref_res_heat(calib, profile.temp[i], 0), 0.7);
+        CHECK(regs[0x64 + i] == gas_wait[i]);
+    }
+
+    // run_gas with the first step
+    CHECK(regs[0x71] == 0x10);
+
+    // the last measured temperature replaces 25 °C before each measurement, at about 72 °C that
+    // still moves them less than a step
+    float temp, pres, hum;
+    bme680_sim_set_adc(BUS, ADDR, 650000, 330000, 21000);
+    for (unsigned int i = 0; i <= profile.count; i++)
+        CHECK(bme680_read(dev, &temp, &pres, &hum) == 0);
+    CHECK(temp > 70);
+
+    for (unsigned int i = 0; i < profile.count; i++)
+        CHECK_NEAR(regs[0x5A + i], ref_res_heat(calib, profile.temp[i], 0), 0.7);
+
+    bme680_close(dev);
+}
+
+// the gas resistance agrees with the vendor's floating-point formula over the ranges with a correction
+static void test_gas_resistance(void) {
+    static const unsigned int gas[][2] = {
+        { 300, 0 }, { 512, 4 }, { 700, 5 }, { 100, 7 }, { 900, 8 }, { 1000, 10 }, { 450, 11 }, { 620, 13 }, { 1023, 15 },
+    };
+    static const struct bme680_heater_profile profile = { 1, { 320 }, { 1 } };
+
+    setup();
+
+    struct bme680 *dev = bme680_open(BUS, ADDR);
+    CHECK(dev != NULL);
+    if (!dev)
+        return;
+
+    CHECK(bme680_set_heater(dev, &profile) == 0);
+
+    for (unsigned int i = 0; i < sizeof(gas) / sizeof(gas[0]); i++) {
+        bme680_sim_set_gas(BUS, ADDR, gas[i][0], gas[i][1]);
+
+        float temp, pres, hum, res = 0;
+        unsigned int step = 1;
+        CHECK(bme680_read(dev, &temp, &pres, &hum) == 0);
+        CHECK(bme680_gas_result(dev, &res, &step) == 0);
+        CHECK(step == 0);
+
+        const double ref = ref_gas_resistance(calib, gas[i][0], gas[i][1]);
+        // in whole Ω
+        CHECK_NEAR(res, ref, ref * 0.001 + 1);
+    }
+
+    bme680_close(dev);
+}
+
+// a record or calibration of the wrong length is recorded for errlog instead of printed
+static void test_decode_raw_length(void) {
+    unsigned char calib_regs[42] = { 0 };
+    struct bme680 *dev = bme680_open_replay(calib_regs, sizeof(calib_regs));
+    CHECK(dev != NULL);
+    if (!dev)
+        return;
+
+    const unsigned char raw[12] = { 0 };
+    CHECK(bme680_decode_raw(dev, raw, sizeof(raw)) == -1);
+
+    struct errlog_event event;
+    CHECK(errlog_last(&event) == ERR_BME680_RAW_LENGTH);
+    CHECK(event.arg == 12);
+
+    // a gas record carries its heater step after the 15 bytes of the burst, decoding it needs a par_p1
+    calib_regs[5] = 0x80;
+    bme680_close(dev);
+    dev = bme680_open_replay(calib_regs, sizeof(calib_regs));
+    CHECK(dev != NULL);
+    if (!dev)
+        return;
+
+    unsigned char gas_raw[16] = { 0x80 };
+    gas_raw[14] = 0x30;
+    gas_raw[15] = 3;
+
+    float gas;
+    unsigned int step = 0;
+    CHECK(bme680_decode_raw(dev, gas_raw, 15) == -1);
+    CHECK(bme680_decode_raw(dev, gas_raw, sizeof(gas_raw)) == 0);
+    CHECK(bme680_gas_result(dev, &gas, &step) == 0);
+    CHECK(step == 3);
+
+    bme680_close(dev);
+
+    CHECK(bme680_open_replay(calib_regs, 41) == NULL);
+    CHECK(errlog_last(&event) == ERR_BME680_CALIB);
+    CHECK(event.arg == 41);
+}
+
+// a deterministic pseudo-random sequence (xorshift64)
+static unsigned long long next_random(unsigned long long *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+
+    return *state;
+}
+
+// the batch compensation gives bit for bit the values of the one-sample path for random calibrations and
+// samples, with a count that leaves a remainder for the scalar tail
+static void test_compensate_matches_decode(void) {
+    enum { SESSIONS = 64, COUNT = 1027 };
+    static unsigned int temp_adc[COUNT], pres_adc[COUNT];
+    static unsigned short hum_adc[COUNT];
+    static float temp[COUNT], pres[COUNT], hum[COUNT], temp_only[COUNT];
+    unsigned long long state = 0x9E3779B97F4A7C15ULL;
+
+    for (unsigned int s = 0; s < SESSIONS; s++) {
+        unsigned char calib_regs[42];
+        for (unsigned int i = 0; i < sizeof(calib_regs); i++)
+            calib_regs[i] = next_random(&state);
+
+        // par_p1 in the range of real sensors, the scalar code divides by a value that scales with it
+        unsigned int p1 = 30000 + next_random(&state) % 10000;
+        calib_regs[4] = p1 & 0xFF;
+        calib_regs[5] = p1 >> 8;
+
+        struct bme680 *dev = bme680_open_replay(calib_regs, sizeof(calib_regs));
+        CHECK(dev != NULL);
+        if (!dev)
+            return;
+
+        for (unsigned int i = 0; i < COUNT; i++) {
+            temp_adc[i] = next_random(&state) & 0xFFFFF;
+            pres_adc[i] = next_random(&state) & 0xFFFFF;
+            hum_adc[i]  = next_random(&state);
+        }
+
+        bme680_compensate(dev, COUNT, temp_adc, pres_adc, hum_adc, temp, pres, hum);
+        bme680_compensate(dev, COUNT, temp_adc, NULL, NULL, temp_only, NULL, NULL);
+
+        unsigned int mismatches = 0;
+        for (unsigned int i = 0; i < COUNT; i++) {
+            // the burst read from 0x1D: status, index, pressure, temperature, humidity
+            const unsigned char raw[10] = {
+                0x80, 0,
+                pres_adc[i] >> 12, pres_adc[i] >> 4, pres_adc[i] << 4,
+                temp_adc[i] >> 12, temp_adc[i] >> 4, temp_adc[i] << 4,
+                hum_adc[i] >> 8, hum_adc[i],
+            };
+
+            float t, p, h;
+            if (bme680_decode_raw(dev, raw, sizeof(raw)) != 0 || bme680_result(dev, &t, &p, &h) != 0) {
+                mismatches++;
+                continue;
+            }
+
+            if (memcmp(&t, &temp[i], sizeof(t)) != 0 || memcmp(&p, &pres[i], sizeof(p)) != 0 ||
+                memcmp(&h, &hum[i], sizeof(h)) != 0 || memcmp(&t, &temp_only[i], sizeof(t)) != 0) {
+                if (mismatches == 0)
+                    fprintf(stderr, "session %u sample %u (%u, %u, %u): %.9g %.9g %.9g, batch %.9g %.9g %.9g\n",
+                        s, i, temp_adc[i], pres_adc[i], hum_adc[i], t, p, h, temp[i], pres[i], hum[i]);
+                mismatches++;
+            }
+        }
+        CHECK(mismatches == 0);
+
+        bme680_close(dev);
+    }
+}
+
+int main(void) {
+    RUN(test_read_matches_reference);
+    RUN(test_read_bme680_data);
+    RUN(test_transactions);
+    RUN(test_not_ready);
+    RUN(test_heater_setpoints);
+    RUN(test_gas_resistance);
+    RUN(test_decode_raw_length);
+    RUN(test_compensate_matches_decode);
+
+    return TEST_EXIT();
+}
@@ -0,0 +1,229 @@
+// The DHT22 driver against scripted waveforms on the simulated GPIO block
+
+#include "test.h"
+
+#include <sched.h>
+#include <time.h>
+
+#include "dht22_waveform.h"
+#include "../interfaces/gpio_sim.h"
+#include "../sensors/sensors.h"
+
+
+#define DHT_PIN 17
+
+static struct GPIO_simStep steps[DHT22_WAVEFORM_STEPS];
+
+// The edges of a transmission of 23.4 °C and 52.1 % as GPIO_readEdges returns them: the response,
+// 40 bits with a few µs of jitter, and the line going idle
+static const struct GPIO_edgeEvent trace[] = {
+    { 5123456814317ULL, GPIO_FALLING }, { 5123456892552ULL, GPIO_RISING  }, { 5123456972786ULL, GPIO_FALLING },
+    { 5123457024118ULL, GPIO_RISING  }, { 5123457046513ULL, GPIO_FALLING }, { 5123457093106ULL, GPIO_RISING  },
+    { 5123457121833ULL, GPIO_FALLING }, { 5123457172222ULL, GPIO_RISING  }, { 5123457194993ULL, GPIO_FALLING },
+    { 5123457243988ULL, GPIO_RISING  }, { 5123457270762ULL, GPIO_FALLING }, { 5123457317237ULL, GPIO_RISING  },
+    { 5123457346689ULL, GPIO_FALLING }, { 5123457396845ULL, GPIO_RISING  }, { 5123457420603ULL, GPIO_FALLING },
+    { 5123457466910ULL, GPIO_RISING  }, { 5123457533614ULL, GPIO_FALLING }, { 5123457583166ULL, GPIO_RISING  },
+    { 5123457608591ULL, GPIO_FALLING }, { 5123457655163ULL, GPIO_RISING  }, { 5123457679134ULL, GPIO_FALLING },
+    { 5123457725877ULL, GPIO_RISING  }, { 5123457752391ULL, GPIO_FALLING }, { 5123457801868ULL, GPIO_RISING  },
+    { 5123457824352ULL, GPIO_FALLING }, { 5123457877125ULL, GPIO_RISING  }, { 5123457903757ULL, GPIO_FALLING },
+    { 5123457950771ULL, GPIO_RISING  }, { 5123458024532ULL, GPIO_FALLING }, { 5123458072360ULL, GPIO_RISING  },
+    { 5123458099526ULL, GPIO_FALLING }, { 5123458150665ULL, GPIO_RISING  }, { 5123458177440ULL, GPIO_FALLING },
+    { 5123458231203ULL, GPIO_RISING  }, { 5123458297709ULL, GPIO_FALLING }, { 5123458348436ULL, GPIO_RISING  },
+    { 5123458375232ULL, GPIO_FALLING }, { 5123458424481ULL, GPIO_RISING  }, { 5123458446887ULL, GPIO_FALLING },
+    { 5123458500884ULL, GPIO_RISING  }, { 5123458524695ULL, GPIO_FALLING }, { 5123458571076ULL, GPIO_RISING  },
+    { 5123458597636ULL, GPIO_FALLING }, { 5123458650668ULL, GPIO_RISING  }, { 5123458673758ULL, GPIO_FALLING },
+    { 5123458722130ULL, GPIO_RISING  }, { 5123458747563ULL, GPIO_FALLING }, { 5123458794744ULL, GPIO_RISING  },
+    { 5123458821173ULL, GPIO_FALLING }, { 5123458868137ULL, GPIO_RISING  }, { 5123458894813ULL, GPIO_FALLING },
+    { 5123458943340ULL, GPIO_RISING  }, { 5123459013929ULL, GPIO_FALLING }, { 5123459066614ULL, GPIO_RISING  },
+    { 5123459138200ULL, GPIO_FALLING }, { 5123459185680ULL, GPIO_RISING  }, { 5123459252524ULL, GPIO_FALLING },
+    { 5123459303288ULL, GPIO_RISING  }, { 5123459329967ULL, GPIO_FALLING }, { 5123459381200ULL, GPIO_RISING  },
+    { 5123459448739ULL, GPIO_FALLING }, { 5123459497789ULL, GPIO_RISING  }, { 5123459520587ULL, GPIO_FALLING },
+    { 5123459571074ULL, GPIO_RISING  }, { 5123459642907ULL, GPIO_FALLING }, { 5123459689421ULL, GPIO_RISING  },
+    { 5123459716044ULL, GPIO_FALLING }, { 5123459762532ULL, GPIO_RISING  }, { 5123459833602ULL, GPIO_FALLING },
+    { 5123459881289ULL, GPIO_RISING  }, { 5123459951355ULL, GPIO_FALLING }, { 5123460002928ULL, GPIO_RISING  },
+    { 5123460073283ULL, GPIO_FALLING }, { 5123460122785ULL, GPIO_RISING  }, { 5123460195152ULL, GPIO_FALLING },
+    { 5123460243725ULL, GPIO_RISING  }, { 5123460269539ULL, GPIO_FALLING }, { 5123460320335ULL, GPIO_RISING  },
+    { 5123460393899ULL, GPIO_FALLING }, { 5123460443611ULL, GPIO_RISING  }, { 5123460468573ULL, GPIO_FALLING },
+    { 5123460517028ULL, GPIO_RISING  }, { 5123460585063ULL, GPIO_FALLING }, { 5123460637570ULL, GPIO_RISING  },
+};
+
+// The edges of a 5-byte frame with the high pulse widths of a 0 and a 1 in µs, starting with the
+// response (response != 0) or the first bit; returns their count
+static unsigned int edges(struct GPIO_edgeEvent *events, const unsigned char frame[5], int response,
+    unsigned int zero_us, unsigned int one_us) {
+    unsigned long long t = 1000000000ULL;
+    unsigned int n = 0;
+
+    if (response) {
+        events[n++] = (struct GPIO_edgeEvent){ t += 30000, GPIO_FALLING };
+        events[n++] = (struct GPIO_edgeEvent){ t += 80000, GPIO_RISING };
+    }
+
+    events[n++] = (struct GPIO_edgeEvent){ t += 80000, GPIO_FALLING };
+
+    for (int i = 0; i < 40; i++) {
+        int bit = frame[i / 8] >> (7 - i % 8) & 1;
+
+        events[n++] = (struct GPIO_edgeEvent){ t += 50000, GPIO_RISING };
+        events[n++] = (struct GPIO_edgeEvent){ t += (bit ? one_us : zero_us) * 1000ULL, GPIO_FALLING };
+    }
+
+    events[n++] = (struct GPIO_edgeEvent){ t += 50000, GPIO_RISING };
+
+    return n;
+}
+
+
+static void script(int temp, unsigned int hum) {
+    unsigned char frame[5];
+    dht22_frame(frame, temp, hum);
+    dht22_waveform(steps, frame, 27, 70);
+
+    GPIO_simReset();
+    GPIO_simScript(DHT_PIN, steps, DHT22_WAVEFORM_STEPS);
+}
+
+// the scripted waveforms play in real time, so a burst of preemption on a loaded machine can fail
+// every attempt of a read; a later read gets through
+#define READS 3
+
+// the busy-polling mode measures the pulses of the scripted transmission
+static void test_read_poll(void) {
+    script(231, 456);
+
+    float temp = 0, hum = 0;
+    int rc = -1;
+    for (int i = 0; i < READS && rc != 0; i++)
+        rc = read_dht22_data(&temp, &hum);
+
+    CHECK(rc == 0);
+    CHECK_NEAR(temp, 23.1, 0.01);
+    CHECK_NEAR(hum, 45.6, 0.01);
+}
+
+// steps every deadline of a sampled read 3 ms late, more than the slack of the 6 ms window after
+// the release
+static int read_sampled_late(float *temp, float *hum) {
+    struct dht22 *dev = dht22_open(DHT22_MODE_SAMPLED);
+    if (!dev)
+        return -1;
+
+    int rc = dht22_start(dev);
+    while (rc == SENSOR_PENDING) {
+        const unsigned long long due = dht22_deadline(dev) + 3000000;
+        const struct timespec ts = { due / 1000000000, due % 1000000000 };
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+        rc = dht22_step(dev);
+    }
+
+    rc = dht22_result(dev, temp, hum, NULL);
+    dht22_close(dev);
+
+    return rc;
+}
+
+// the sampler releases the line itself, so a late step still gets the whole transmission
+static void test_read_sampled_late(void) {
+    script(-52, 613);
+
+    float temp = 0, hum = 0;
+    int rc = -1;
+    for (int i = 0; i < READS && rc != 0; i++)
+        rc = read_sampled_late(&temp, &hum);
+
+    CHECK(rc == 0);
+    CHECK_NEAR(temp, -5.2, 0.01);
+    CHECK_NEAR(hum, 61.3, 0.01);
+}
+
+// a captured transmission decodes to the values it was sent with
+static void test_decode_trace(void) {
+    float temp, hum, margin;
+    CHECK(dht22_decode_edges(trace, sizeof(trace) / sizeof(trace[0]), &temp, &hum, &margin) == 0);
+    CHECK_NEAR(temp, 23.4, 0.01);
+    CHECK_NEAR(hum, 52.1, 0.01);
+    CHECK(margin > 0.5);
+}
+
+// the data bits are the last 40 high pulses, so losing the edges of the response does not matter,
+// but losing a bit does
+static void test_decode_missed_response(void) {
+    const unsigned int count = sizeof(trace) / sizeof(trace[0]);
+
+    float temp, hum;
+    CHECK(dht22_decode_edges(&trace[2], count - 2, &temp, &hum, NULL) == 0);
+    CHECK_NEAR(temp, 23.4, 0.01);
+    CHECK_NEAR(hum, 52.1, 0.01);
+
+    CHECK(dht22_decode_edges(&trace[5], count - 5, &temp, &hum, NULL) == -1);
+}
+
+// the sign bit of the temperature
+static void test_decode_negative(void) {
+    struct GPIO_edgeEvent events[84];
+    unsigned char frame[5];
+    dht22_frame(frame, -101, 873);
+
+    float temp, hum;
+    CHECK(dht22_decode_edges(events, edges(events, frame, 1, 26, 71), &temp, &hum, NULL) == 0);
+    CHECK_NEAR(temp, -10.1, 0.01);
+    CHECK_NEAR(hum, 87.3, 0.01);
+}
+
+// a flipped bit fails the checksum
+static void test_decode_checksum(void) {
+    struct GPIO_edgeEvent events[84];
+    unsigned char frame[5];
+    dht22_frame(frame, 200, 400);
+    frame[1] ^= 0x04;
+
+    float temp, hum;
+    CHECK(dht22_decode_edges(events, edges(events, frame, 1, 27, 70), &temp, &hum, NULL) == -1);
+}
+
+// with all bits 0 the pulses form a single cluster, so the fixed threshold decides
+static void test_decode_all_zero(void) {
+    struct GPIO_edgeEvent events[84];
+    const unsigned char frame[5] = { 0 };
+
+    float temp = -1, hum = -1, margin = 0;
+    CHECK(dht22_decode_edges(events, edges(events, frame, 1, 28, 70), &temp, &hum, &margin) == 0);
+    CHECK(temp == 0);
+    CHECK(hum == 0);
+    CHECK(margin == 1);
+
+    // pulses widened towards the threshold still decode, but with less confidence
+    CHECK(dht22_decode_edges(events, edges(events, frame, 1, 45, 70), &temp, &hum, &margin) == 0);
+    CHECK(temp == 0);
+    CHECK(margin < 0.5);
+}
+
+// too few edges for 40 bits
+static void test_decode_truncated(void) {
+    float temp, hum;
+    CHECK(dht22_decode_edges(trace, 40, &temp, &hum, NULL) == -1);
+    CHECK(dht22_decode_edges(trace, 0, &temp, &hum, NULL) == -1);
+}
+
+int main(void) {
+    RUN(test_decode_trace);
+    RUN(test_decode_missed_response);
+    RUN(test_decode_negative);
+    RUN(test_decode_checksum);
+    RUN(test_decode_all_zero);
+    RUN(test_decode_truncated);
+
+    // the first backend initialized stays, so the drivers never touch the real GPIO
+    GPIO_initBackend(&GPIO_simBackend);
+
+    // the simulated pulses are timed in µs, so preemption distorts them; SCHED_FIFO (inherited by
+    // the sampler thread) keeps other processes out where it is permitted
+    const struct sched_param param = { .sched_priority = 1 };
+    sched_setscheduler(0, SCHED_FIFO, &param);
+
+    RUN(test_read_poll);
+    RUN(test_read_sampled_late);
+
+    return TEST_EXIT();
+}
@@ -0,0 +1,115 @@
+// The pin handling of the GPIO layer against the simulated backend
+
+#include "test.h"
+
+#include "../interfaces/errlog.h"
+#include "../interfaces/gpio_sim.h"
+
+
+// pins 0-31 are set up through the mask
+static void test_setup(void) {
+    GPIO_simReset();
+
+    CHECK(GPIO_setup(8, GPIO_OUT) == GPIO_SUCCESS);
+    GPIO_output(8, GPIO_LOW);
+    CHECK(GPIO_input(8) == GPIO_LOW);
+
+    // the released pin is pulled up
+    CHECK(GPIO_setup(8, GPIO_IN) == GPIO_SUCCESS);
+    CHECK(GPIO_input(8) == GPIO_HIGH);
+}
+
+// pins 32-53 are driven and read through the second bank instead of aliasing pin & 31
+static void test_high_pin_io(void) {
+    GPIO_simReset();
+
+    CHECK(GPIO_setup(8, GPIO_OUT) == GPIO_SUCCESS);
+    GPIO_output(8, GPIO_LOW);
+
+    CHECK(GPIO_setup(40, GPIO_OUT) == GPIO_SUCCESS);
+    GPIO_output(40, GPIO_HIGH);
+    CHECK(GPIO_input(40) == GPIO_HIGH);
+    CHECK(GPIO_input(8) == GPIO_LOW);
+
+    GPIO_output(40, GPIO_LOW);
+    GPIO_output(8, GPIO_HIGH);
+    CHECK(GPIO_input(40) == GPIO_LOW);
+    CHECK(GPIO_input(8) == GPIO_HIGH);
+
+    // the released pin is pulled up, pin 8 is still an output
+    CHECK(GPIO_setup(40, GPIO_IN) == GPIO_SUCCESS);
+    CHECK(GPIO_input(40) == GPIO_HIGH);
+    GPIO_output(8, GPIO_LOW);
+    CHECK(GPIO_input(8) == GPIO_LOW);
+}
+
+// pins the backend does not have are rejected, nothing else changes
+static void test_missing_pin(void) {
+    GPIO_simReset();
+
+    CHECK(GPIO_setup(8, GPIO_OUT) == GPIO_SUCCESS);
+    GPIO_output(8, GPIO_LOW);
+
+    struct errlog_event event;
+    CHECK(GPIO_setup(54, GPIO_IN) == GPIO_FAILURE);
+    CHECK(errlog_last(&event) == ERR_GPIO_PIN);
+    CHECK(event.arg == 54);
+
+    CHECK(GPIO_input(60) == GPIO_FAILURE);
+    GPIO_output(72, GPIO_HIGH);
+    CHECK(errlog_last(&event) == ERR_GPIO_PIN);
+    CHECK(event.arg == 72);
+
+    CHECK(GPIO_input(8) == GPIO_LOW);
+}
+
+// the sampler reads a pin of the second bank from that bank
+static void test_sampler_high_pin(void) {
+    static const struct GPIO_simStep steps[] = {
+        { 20000, GPIO_LOW },
+        { 1, GPIO_HIGH },
+    };
+    unsigned int samples[400 / 32 + 1];
+
+    GPIO_simReset();
+    GPIO_simScript(40, steps, 2);
+
+    // pin 8 is low, an aliasing sampler would only see that
+    CHECK(GPIO_setup(8, GPIO_OUT) == GPIO_SUCCESS);
+    GPIO_output(8, GPIO_LOW);
+
+    CHECK(GPIO_setup(40, GPIO_OUT) == GPIO_SUCCESS);
+    CHECK(GPIO_setup(40, GPIO_IN) == GPIO_SUCCESS);
+
+    struct GPIO_sampler sampler = {
+        .pin = 40, .period_ns = 100000, .cpu = -1, .release = -1,
+        .samples = samples, .count = 400,
+    };
+    CHECK(GPIO_samplerStart(&sampler) == GPIO_SUCCESS);
+    CHECK(GPIO_samplerWait(&sampler) == GPIO_SUCCESS);
+
+    unsigned int runs[8];
+    enum GPIO_STATE first;
+    CHECK(GPIO_samplerRuns(&sampler, runs, 8, &first) == 2);
+    CHECK(first == GPIO_LOW);
+}
+
+// an invalid mode is rejected
+static void test_setup_mode(void) {
+    GPIO_simReset();
+
+    CHECK(GPIO_setup(8, (enum GPIO_MODE)7) == GPIO_FAILURE);
+    CHECK(errlog_last(NULL) == ERR_GPIO_MODE);
+}
+
+int main(void) {
+    GPIO_initBackend(&GPIO_simBackend);
+
+    RUN(test_setup);
+    RUN(test_high_pin_io);
+    RUN(test_missing_pin);
+    RUN(test_sampler_high_pin);
+    RUN(test_setup_mode);
+
+    return TEST_EXIT();
+}
@@ -0,0 +1,148 @@
+// The sample bus ring with one and with several producers
+
+#include "test.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "../sensors/sample_bus.h"
+
+
+#define PRODUCERS 4
+#define PER_PRODUCER 200000
+
+// a small ring, so the producers lap each other and the reader all the time
+#define RING 8
+
+static struct sample_bus *bus;
+static atomic_ulong published;
+static atomic_int producing;
+
+// every value of a sample is its sequence number within its producer, a torn copy mixes two of them
+static struct sample make(unsigned int id, unsigned int n) {
+    return (struct sample){ id, SAMPLE_MAX_VALUES, n, { n, n, n, n } };
+}
+
+static int intact(const struct sample *s) {
+    for (unsigned int i = 0; i < SAMPLE_MAX_VALUES; i++)
+        if (s->values[i] != (float)s->timestamp_ns)
+            return 0;
+
+    return s->sensor_id < PRODUCERS && s->count == SAMPLE_MAX_VALUES;
+}
+
+// a reader sees every sample in order, and is told how many it lost when the ring wrapped past it
+static void test_single(void) {
+    struct sample_bus *b = sample_bus_create(5);
+    CHECK(b != NULL);
+    if (!b)
+        return;
+
+    struct sample_reader reader;
+    sample_reader_init(&reader, b, 0);
+
+    struct sample s;
+    CHECK(sample_reader_next(&reader, &s) == 0);
+
+    for (unsigned int n = 0; n < 3; n++)
+        CHECK(sample_bus_publish(b, &(struct sample){ 1, 1, n, { n } }) == 1);
+
+    for (unsigned int n = 0; n < 3; n++) {
+        CHECK(sample_reader_next(&reader, &s) == 1);
+        CHECK(s.timestamp_ns == n);
+    }
+    CHECK(sample_reader_next(&reader, &s) == 0);
+
+    // the size is rounded up to 8, 10 more samples overwrite the 2 oldest of them
+    for (unsigned int n = 3; n < 13; n++)
+        sample_bus_publish(b, &(struct sample){ 1, 1, n, { n } });
+
+    CHECK(sample_reader_next(&reader, &s) == 1);
+    CHECK(s.timestamp_ns == 5);
+    CHECK(reader.lost == 2);
+
+    CHECK(sample_bus_latest(b, 1, &s) == 1);
+    CHECK(s.timestamp_ns == 12);
+    CHECK(sample_bus_latest(b, 2, &s) == 0);
+
+    sample_bus_destroy(b);
+}
+
+static void *produce(void *arg) {
+    const unsigned int id = (unsigned int)(size_t)arg;
+    unsigned long n = 0;
+
+    for (unsigned int i = 0; i < PER_PRODUCER; i++) {
+        const struct sample s = make(id, i);
+        n += sample_bus_publish(bus, &s);
+    }
+
+    atomic_fetch_add(&published, n);
+    atomic_fetch_sub(&producing, 1);
+
+    return NULL;
+}
+
+// producers racing for the slots never leave a torn or out of order sample, and every position is
+// either read or counted as lost
+static void test_producers(void) {
+    bus = sample_bus_create(RING);
+    CHECK(bus != NULL);
+    if (!bus)
+        return;
+
+    struct sample_reader reader;
+    sample_reader_init(&reader, bus, 1);
+
+    atomic_store(&producing, PRODUCERS);
+
+    pthread_t threads[PRODUCERS];
+    for (unsigned int i = 0; i < PRODUCERS; i++)
+        pthread_create(&threads[i], NULL, produce, (void *)(size_t)i);
+
+    unsigned long reads = 0, torn = 0, reordered = 0;
+    long long last[PRODUCERS] = { -1, -1, -1, -1 };
+
+    struct sample s;
+    for (;;) {
+        int done = atomic_load(&producing) == 0;
+
+        while (sample_reader_next(&reader, &s)) {
+            reads++;
+
+            if (!intact(&s)) {
+                torn++;
+                continue;
+            }
+
+            if ((long long)s.timestamp_ns <= last[s.sensor_id])
+                reordered++;
+            last[s.sensor_id] = s.timestamp_ns;
+        }
+
+        if (done)
+            break;
+    }
+
+    for (unsigned int i = 0; i < PRODUCERS; i++)
+        pthread_join(threads[i], NULL);
+
+    CHECK(torn == 0);
+    CHECK(reordered == 0);
+    CHECK(reads + reader.lost == (unsigned long)PRODUCERS * PER_PRODUCER);
+    CHECK(atomic_load(&published) <= (unsigned long)PRODUCERS * PER_PRODUCER);
+
+    // the newest sample of each producer left in the ring is intact
+    for (unsigned int i = 0; i < PRODUCERS; i++)
+        if (sample_bus_latest(bus, i, &s))
+            CHECK(intact(&s) && s.sensor_id == i);
+
+    sample_bus_destroy(bus);
+}
+
+int main(void) {
+    RUN(test_single);
+    RUN(test_producers);
+
+    return TEST_EXIT();
+}
@@ -0,0 +1,87 @@
+// The MH-Z19C driver against the pseudo-terminal emulator
+
+#include "test.h"
+
+#include "../sensors/mh_z19c_sim.h"
+#include "../sensors/sensors.h"
+
+
+static struct z19c_sim *sim;
+
+static void configure(const struct z19c_sim_config *config) {
+    z19c_sim_configure(sim, config);
+}
+
+// the one-shot read opens the configured port
+static void test_read_z19c_data(void) {
+    configure(&(struct z19c_sim_config){ .co2 = 812 });
+
+    unsigned short co2 = 0;
+    CHECK(read_z19c_data(&co2) == 0);
+    CHECK(co2 == 812);
+}
+
+// a response split into pieces and preceded by garbage is reassembled
+static void test_fragmented(void) {
+    configure(&(struct z19c_sim_config){ .co2 = 1234, .fragment = 2, .fragment_delay_ms = 2, .garbage = 20 });
+
+    struct z19c *dev = z19c_open(z19c_sim_path(sim));
+    CHECK(dev != NULL);
+    if (!dev)
+        return;
+
+    for (int i = 0; i < 3; i++) {
+        unsigned short co2 = 0;
+        CHECK(z19c_read(dev, &co2, 500) == 0);
+        CHECK(co2 == 1234);
+    }
+
+    z19c_close(dev);
+}
+
+// a response with a wrong checksum is rejected, the next read succeeds again
+static void test_corrupted(void) {
+    configure(&(struct z19c_sim_config){ .co2 = 600, .corrupt_every = 2 });
+
+    struct z19c *dev = z19c_open(z19c_sim_path(sim));
+    CHECK(dev != NULL);
+    if (!dev)
+        return;
+
+    int ok = 0, failed = 0;
+    for (int i = 0; i < 4; i++) {
+        unsigned short co2 = 0;
+        if (z19c_read(dev, &co2, 100) == 0 && co2 == 600)
+            ok++;
+        else
+            failed++;
+    }
+
+    CHECK(ok == 2);
+    CHECK(failed == 2);
+
+    z19c_close(dev);
+}
+
+int main(void) {
+    sim = z19c_sim_start(&(struct z19c_sim_config){ .co2 = 400 });
+    CHECK(sim != NULL);
+    if (!sim)
+        return TEST_EXIT();
+
+    z19c_set_path(z19c_sim_path(sim));
+
+    RUN(test_read_z19c_data);
+    RUN(test_fragmented);
+    RUN(test_corrupted);
+
+    struct z19c_sim_stats stats;
+    z19c_sim_get_stats(sim, &stats);
+    CHECK(stats.reads == 1 + 3 + 4);
+    CHECK(stats.invalid_commands == 0);
+
+    z19c_set_path(NULL);
+    z19c_sim_stop(sim);
+
+    return TEST_EXIT();
+}